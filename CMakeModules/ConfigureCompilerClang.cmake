@@ -96,5 +96,12 @@ add_compile_options("-fPIC")
 set(CMAKE_CXX_FLAGS_DEBUG "${CMAKE_CXX_FLAGS_DEBUG} -ggdb3")
 # Add the basic compiler options for release version
 #add_compile_options($<$<CONFIG:Release>:-ansi -march=native -funroll-loops -O3>)
-set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} -ansi -march=native -funroll-loops -O3 -DNDEBUG")
+# Portable builds target x86-64-v2 (spelled out for older compilers), so the rank/select of the BWT
+# keeps hardware popcount, and the AVX2/AVX-512 kernels are then chosen at runtime
+if(SPUMONI_PORTABLE)
+  set(SPUMONI_PORTABLE_ARCH "-march=x86-64 -mcx16 -msahf -mpopcnt -msse3 -mssse3 -msse4.1 -msse4.2")
+  set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} -ansi ${SPUMONI_PORTABLE_ARCH} -mtune=generic -funroll-loops -O3 -DNDEBUG")
+else()
+  set(CMAKE_CXX_FLAGS_RELEASE "${CMAKE_CXX_FLAGS_RELEASE} -ansi -march=native -funroll-loops -O3 -DNDEBUG")
+endif()
 #add_definitions($<$<CONFIG:Release>:-DNDEBUG>)
@@ -10,23 +10,46 @@
 #define COMPUTE_MS_PML_H
 
 #include <emp_null_database.hpp>
+#include <doc_array.hpp>
+
+#define INDEX_BENCH_LOOKUPS 1000000 // number of random lookups used to time the index
+#define INDEX_BENCH_SEED 42
+#define LARGE_BATCH_BASES 1000000 // batches queried as a whole (-B, -O), larger ones share more work
+#define LOCALITY_KEY_SYMBOLS 8 // number of symbols at the end of a query used to reorder a batch
+
+/* Size and lookup latency of an index, measured during build */
+struct IndexBenchmark {
+    rlbwt_type bwt_type = RLBWT_NONE;
+    thresholds_type thr_type = THR_NONE;
+    size_t index_bytes = 0; // size of the whole index file
+    size_t thresholds_bytes = 0; // size of the thresholds alone
+    double thr_lookup_ns = 0.0; // average time to get the threshold of a random run
+    double lf_step_ns = 0.0; // average time of an LF step from a random position
+    size_t samples_bytes = 0; // size of the SA samples that are stored (MS only)
+    size_t full_samples_bytes = 0; // size of the SA samples before subsampling (MS only)
+    double sample_lookup_ns = 0.0; // average time to get the sample at the end of a random run (MS only)
+};
 
 /* Function Declarations */
 int run_spumoni_ms_main(SpumoniRunOptions* run_opts);
 int run_spumoni_main(SpumoniRunOptions* run_opts);
-std::pair<size_t, size_t> build_spumoni_ms_main(std::string ref_file);
-std::pair<size_t, size_t> build_spumoni_main(std::string ref_file);
+std::pair<size_t, size_t> build_spumoni_ms_main(std::string ref_file, rlbwt_type bwt_type, thresholds_type thr_type, 
+                                                size_t ssa_rate, IndexBenchmark& bench);
+std::pair<size_t, size_t> build_spumoni_main(std::string ref_file, rlbwt_type bwt_type, thresholds_type thr_type, IndexBenchmark& bench);
+void find_doc_starts(std::string ref_file, bool use_pml_index, DocumentArray& doc_arr);
 void generate_null_ms_statistics(std::string ref_file, std::string pattern_file, std::vector<size_t>& ms_stats,
-                                 bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w);
+                                 bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w,
+                                 bool use_canonical);
 void generate_null_pml_statistics(std::string ref_file, std::string pattern_file, std::vector<size_t>& pml_stats,
-                                  bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w);
+                                  bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w,
+                                 bool use_canonical);
 void generate_null_ms_statistics_for_general_text(std::string ref_file, std::string pattern_file, std::vector<size_t>& ms_stats);
 void generate_null_pml_statistics_for_general_text(std::string ref_file, std::string pattern_file, std::vector<size_t>& pml_stats);
 void find_threshold_based_on_null_pml_distribution(const char* ref_file, const char* null_reads, bool use_minimizers,
-                                                   bool use_promotions, bool use_dna_letters, size_t k, size_t w, 
+                                                   bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool use_canonical,
                                                    EmpNullDatabase& null_db, size_t bin_width);
 void find_threshold_based_on_null_ms_distribution(const char* ref_file, const char* null_reads, bool use_minimizers,
-                                                  bool use_promotions, bool use_dna_letters, size_t k, size_t w, 
+                                                  bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool use_canonical,
                                                   EmpNullDatabase& null_db, size_t bin_width);
 std::pair<ulint, ulint> get_bwt_stats(std::string ref_file, size_t type);
 
@@ -0,0 +1,33 @@
+ /*
+  * File: cpu_dispatch.hpp
+  * Description: Header file for cpu_dispatch.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: Each kernel is compiled for several instruction sets using
+  *       function target attributes, and the fastest one supported by
+  *       the current cpu is chosen the first time get_cpu_kernels() is
+  *       called. This lets a single portable binary use AVX2/AVX-512
+  *       when they are available.
+  */
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct CpuKernels {
+    void (*to_upper)(char* seq, size_t length); // converts sequence to upper-case in-place
+    size_t (*max_value)(const size_t* values, size_t length); // maximum over a non-empty range
+
+    const char* to_upper_isa = "scalar";
+    const char* max_value_isa = "scalar";
+};
+
+const CpuKernels& get_cpu_kernels();
+void print_cpu_kernels(const char* func);
+void append_values(std::string& out, const size_t* values, size_t length);
+
+#endif /* End of CPU_DISPATCH_H */
@@ -11,8 +11,12 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <sdsl/vectors.hpp>
 
+#define DOC_BUILD_CHUNK 65536 // samples per task during build, a multiple of 64 so tasks never share a word
+
 class DocumentArray {
 
 public:
@@ -22,16 +26,67 @@ public:
     sdsl::int_vector<> start_runs_doc; // represents the start of runs document array
     sdsl::int_vector<> end_runs_doc; // represents the end of runs document array
 
+    // run-length encoded form: a bit marks each run whose document differs from the run before it
+    bool run_length = false;
+    sdsl::sd_vector<> start_doc_heads, end_doc_heads;
+    sdsl::sd_vector<>::rank_1_type start_doc_rank, end_doc_rank;
+    sdsl::int_vector<> start_doc_values, end_doc_values;
+
+    // labels of the documents at coarser levels (e.g. species, genus), from the extra columns of the .fdi
+    std::vector<sdsl::int_vector<>> parent_ids; // parent_ids[l][i] is the parent of label i at level l, level 0 is the documents
+    std::vector<std::vector<std::string>> level_labels; // level_labels[l-1][i] is the name of label i at level l
+
+    // BWT rows whose character is the first one of a document (in increasing order), and that document,
+    // so an LF walk can tell when it would step back into the document before
+    sdsl::int_vector<> doc_start_rows;
+    sdsl::int_vector<> doc_start_ids;
+
     DocumentArray(){} // Constructor used to load an existing document array
     DocumentArray(std::string file_path, size_t num_runs); // Main constructor
+
+    // the rank supports point into this object, so it should not be copied
+    DocumentArray(const DocumentArray&) = delete;
+    DocumentArray& operator=(const DocumentArray&) = delete;
+
+    inline size_t start_doc(size_t run) const {
+        /* Returns the document at the start of the run */
+        if (!run_length) return start_runs_doc[run];
+        return start_doc_values[start_doc_rank(run + 1) - 1];
+    }
+    inline size_t end_doc(size_t run) const {
+        /* Returns the document at the end of the run */
+        if (!run_length) return end_runs_doc[run];
+        return end_doc_values[end_doc_rank(run + 1) - 1];
+    }
+
+    inline size_t next_doc_start(size_t row) const {
+        /* Returns the index of the first document start at or after the BWT row */
+        return std::lower_bound(doc_start_rows.begin(), doc_start_rows.end(), row) - doc_start_rows.begin();
+    }
+    bool has_doc_starts() const {return doc_start_rows.size() > 0;}
+
+    void find_doc_starts(const std::function<size_t(size_t)>& LF);
+
+    size_t num_levels() const {return parent_ids.size() + 1;}
+    inline size_t parent(size_t id, size_t level) const {return parent_ids[level][id];}
+    const std::string& label_name(size_t id, size_t level) const {return level_labels[level-1][id];}
+
+    void run_length_encode();
+    size_t size_in_bytes() const;
+    static std::string get_file_extension(std::string ref_file);
     
     void load_seq_boundaries();
     void print_statistics();
     static size_t grab_file_size(std::string file_path);
-    static std::vector<size_t> read_samples(std::string file_path);
-    static size_t binary_search_for_pos(std::vector<size_t> end_pos, size_t sample_pos);
+    static size_t binary_search_for_pos(const std::vector<size_t>& end_pos, size_t sample_pos);
+    static void fill_run_docs(std::string file_path, const std::vector<size_t>& end_pos, sdsl::int_vector<>& run_docs);
     size_t serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "");
-    void load(std::istream& in);
+    void load(std::istream& in, bool use_run_length = false);
+
+private:
+    void build_hierarchy(const std::vector<std::vector<std::string>>& doc_labels);
+    static void encode_runs(const sdsl::int_vector<>& run_docs, sdsl::sd_vector<>& heads, sdsl::int_vector<>& values);
+    std::vector<std::pair<size_t, size_t>> read_sample_rows() const;
 }; // end of DocumentArray Class
 
 #endif /* end of _DOCARRAY_H */
\ No newline at end of file
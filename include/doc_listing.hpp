@@ -0,0 +1,134 @@
+ /*
+  * File: doc_listing.hpp
+  * Description: Lists every document that contains a match, using the
+  *              r-index and the document array at the BWT run boundaries.
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The suffixes with a match as prefix form a range of the BWT. The
+  *       document is known at the ends of each run, and the positions inside
+  *       a run all have the same character, so they map to a range under LF.
+  *       Each part of the range is followed until it reaches the end of a run,
+  *       so only documents are visited, not every occurrence. The documents
+  *       are concatenated, so a walk that reaches the first character of a
+  *       document stops there with that document, instead of stepping back
+  *       into the document before it.
+  *
+  *       A range inside a run keeps its size until it reaches a run boundary
+  *       or a document start, which can take as many LF steps as the document
+  *       is long. So each match gets a budget of steps (spumoni run -S), and
+  *       a listing that runs out of it is marked with a '*'.
+  */
+
+#ifndef DOC_LISTING_H
+#define DOC_LISTING_H
+
+#include <doc_array.hpp>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+class DocumentLister {
+public:
+    std::vector<size_t> docs; // documents that contain the last match listed, in increasing order
+    bool complete = true; // whether the last listing covered the whole range
+
+    size_t max_steps = 0; // LF steps spent on one match before its listing is cut short, 0 means no bound
+    size_t num_matches = 0;
+    size_t num_docs = 0; // total over all matches listed
+    size_t num_truncated = 0;
+
+    DocumentLister(size_t max_steps = 0): max_steps(max_steps) {}
+
+    template <class bwt_t>
+    void list(bwt_t& bwt, const std::vector<uint64_t>& F, const char* pattern, size_t m, const DocumentArray& doc_arr) {
+        /* Finds the BWT range of the pattern with backward search, and lists the documents in it */
+        docs.clear();
+        complete = true;
+        num_matches++;
+
+        uint64_t sp = 0, ep = bwt.size() - 1;
+        for (size_t i = m; i-- > 0 && sp <= ep;) {
+            const uint8_t c = static_cast<uint8_t>(pattern[i]);
+            sp = F[c] + bwt.rank(sp, c);
+            ep = F[c] + bwt.rank(ep + 1, c);
+            if (ep == 0) return;
+            ep--;
+        }
+        if (sp > ep) return;
+
+        size_t num_steps = 0;
+        pending.assign(1, {sp, ep});
+        while (!pending.empty()) {
+            uint64_t x = pending.back().first, y = pending.back().second;
+            pending.pop_back();
+
+            // split the range at the run boundaries, the ends of a run have a known document
+            while (x <= y) {
+                size_t run = bwt.run_of_position(x);
+                auto run_range = bwt.run_range(run);
+                uint64_t piece_end = std::min<uint64_t>(y, run_range.second);
+                uint64_t lo = x, hi = piece_end;
+
+                if (lo == run_range.first) {add_doc(doc_arr.start_doc(run)); lo++;}
+                if (hi == run_range.second && hi >= lo) {add_doc(doc_arr.end_doc(run)); hi--;}
+
+                // the inside of the run is one character, so its positions stay together after an LF step,
+                // except the ones at the start of a document, which would step back into the one before
+                for (size_t i = doc_arr.next_doc_start(lo); lo <= hi; i++) {
+                    uint64_t stop = (i < doc_arr.doc_start_rows.size()) ? std::min<uint64_t>(doc_arr.doc_start_rows[i], hi + 1) : hi + 1;
+                    if (lo < stop) {
+                        if (max_steps && num_steps++ == max_steps) {complete = false; break;}
+                        const uint8_t c = bwt[lo];
+                        uint64_t next_lo = F[c] + bwt.rank(lo, c);
+                        pending.push_back({next_lo, next_lo + (stop - 1 - lo)});
+                    }
+                    if (stop <= hi) {add_doc(doc_arr.doc_start_ids[i]);}
+                    lo = stop + 1;
+                }
+                if (!complete) break;
+                x = piece_end + 1;
+            }
+            if (!complete) {pending.clear();}
+        }
+
+        for (size_t doc: docs) {seen[doc] = 0;}
+        std::sort(docs.begin(), docs.end());
+        num_docs += docs.size();
+        num_truncated += !complete;
+    }
+
+    void append_docs(std::string& text) const {
+        /* Writes the documents as a comma-separated list, where consecutive documents are a single range (e.g. 0-3,7) */
+        char buf[48];
+        for (size_t i = 0; i < docs.size();) {
+            size_t j = i;
+            while (j + 1 < docs.size() && docs[j + 1] == docs[j] + 1) {j++;}
+
+            int len = (j > i) ? std::snprintf(buf, sizeof(buf), "%s%zu-%zu", (i) ? "," : "", docs[i], docs[j])
+                              : std::snprintf(buf, sizeof(buf), "%s%zu", (i) ? "," : "", docs[i]);
+            text.append(buf, len);
+            i = j + 1;
+        }
+        if (!complete) {text.push_back('*');}
+    }
+
+    void reset_counters() {
+        num_matches = 0;
+        num_docs = 0;
+        num_truncated = 0;
+    }
+
+private:
+    std::vector<std::pair<uint64_t, uint64_t>> pending; // ranges that still need to be split into runs
+    std::vector<uint8_t> seen; // marks the documents in docs, cleared after each match
+
+    inline void add_doc(size_t doc) {
+        if (doc >= seen.size()) {seen.resize(doc + 1, 0);}
+        if (!seen[doc]) {seen[doc] = 1; docs.push_back(doc);}
+    }
+};
+
+#endif /* End of DOC_LISTING_H */
@@ -0,0 +1,51 @@
+ /*
+  * File: doc_vote.hpp
+  * Description: Header file for doc_vote.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The DocumentVoter assigns each read to a document, where every
+  *       position votes for its document weighted by its MS/PML length, so
+  *       long matches count for more than short random ones. If the document
+  *       array has a label hierarchy, the read is also assigned at each level
+  *       above with the parent table, so there is no extra query per level.
+  *       Each thread keeps its own voter with the counts of the reads it
+  *       assigned, and the voters are merged once at the end.
+  */
+
+#ifndef DOC_VOTE_H
+#define DOC_VOTE_H
+
+#include <spumoni_main.hpp>
+#include <doc_array.hpp>
+#include <string>
+#include <vector>
+#include <iostream>
+
+class DocumentVoter {
+public:
+    std::vector<std::vector<size_t>> winners; // labels the last read was assigned to at each level, empty if not assigned
+    size_t best_score = 0; // weighted votes of the winning documents
+    size_t total_score = 0; // weighted votes of all the documents
+
+    std::vector<std::vector<double>> label_reads; // number of reads assigned to each label of each level (ties may split a read)
+    std::vector<size_t> num_unassigned; // number of reads without a label at each level
+    size_t num_reads = 0;
+
+    DocumentVoter(vote_rule rule, const DocumentArray* doc_arr);
+
+    void vote(const std::vector<size_t>& lengths, const std::vector<size_t>& doc_nums);
+    void append_assignment(std::string& text) const;
+    void merge(const DocumentVoter& other);
+    void write_abundance(std::ostream& out) const;
+
+private:
+    vote_rule rule = VOTE_SPLIT;
+    const DocumentArray* doc_arr = nullptr; // used for the parent tables and label names
+    std::vector<size_t> scores; // votes of the current read for each document
+    std::vector<size_t> voted_docs; // documents with votes for the current read, so scores is cleared quickly
+
+    void assign_upper_levels();
+};
+
+#endif /* End of DOC_VOTE_H */
@@ -23,10 +23,12 @@ public:
     double ks_stat_threshold = 0.0; // threshold used for classification
     double mean_null_stat = 0.0;
     double percentile_value = 0.0;
+    bool use_canonical = false; // reads were digested into canonical minimizers (built with -C)
     
     EmpNullDatabase(){} // constructor used for loading
     EmpNullDatabase(const char* ref_file, const char* null_reads, bool use_minimizers, output_type stat_type,
-                    bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool is_general_text);
+                    bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool use_canonical,
+                    bool is_general_text);
 
     size_t serialize(std::ostream &out, sdsl::structure_tree_node *v = nullptr, std::string name = "");
     void load(std::istream& in);
@@ -0,0 +1,50 @@
+ /*
+  * File: hugepage_utils.hpp
+  * Description: Header file for hugepage_utils.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: While a HugePageScope is alive, every large allocation made by that
+  *       thread (the arrays of the index while it is loaded) gets its own
+  *       2 MB aligned slot inside an address range that is set aside once.
+  *       A slot is backed by reserved huge pages (/proc/sys/vm/nr_hugepages)
+  *       on the NUMA node of the scope if there are any left, and by regular
+  *       pages advised for transparent huge pages otherwise. Everything else
+  *       in the process, and allocations made outside of a scope, stays with
+  *       malloc. The slots are not inherited by child processes.
+  */
+
+#ifndef HUGEPAGE_UTILS_H
+#define HUGEPAGE_UTILS_H
+
+#include <string>
+#include <vector>
+
+#define HUGEPAGE_SIZE (2UL * 1024 * 1024)
+#define HUGEPAGE_MIN_ALLOC (1UL * 1024 * 1024)
+#define HUGEPAGE_ARENA_SIZE (1UL << 40)
+#define HUGEPAGE_NO_NODE -1
+#define HUGEPAGE_SCOPE_OFF -2
+
+struct HugePageStats {
+    size_t reserved_bytes = 0; // placed on reserved huge pages
+    size_t advised_bytes = 0; // placed on regular pages, and advised for transparent huge pages
+};
+
+class HugePageScope {
+public:
+    explicit HugePageScope(int node_id = HUGEPAGE_NO_NODE);
+    ~HugePageScope();
+
+    HugePageScope(const HugePageScope&) = delete;
+    HugePageScope& operator=(const HugePageScope&) = delete;
+
+private:
+    int prev_node = HUGEPAGE_SCOPE_OFF; // scope of the thread before this one, so they can nest
+};
+
+HugePageStats get_hugepage_stats();
+size_t get_anon_hugepage_bytes();
+std::string get_thp_mode();
+
+#endif /* End of HUGEPAGE_UTILS_H */
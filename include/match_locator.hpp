@@ -0,0 +1,115 @@
+ /*
+  * File: match_locator.hpp
+  * Description: Locates the occurrences of maximal matches in the text,
+  *              using the toehold of the backward search and the Phi
+  *              function of the MS index.
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The backward search of a match keeps the text position of the
+  *       last suffix in its BWT range, and Phi gives the position of the
+  *       suffix just before it, so the other occurrences are reached with
+  *       one Phi step each. The matches of a read are located together, one
+  *       step at a time for all of them, and the positions of each step are
+  *       sorted so the predecessor searches go through the samples in order.
+  */
+
+#ifndef MATCH_LOCATOR_H
+#define MATCH_LOCATOR_H
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+
+class MatchLocator {
+public:
+    struct located_match {
+        size_t count = 0; // occurrences of the match in the text
+        size_t first = 0; // index of its first occurrence in occs
+        size_t located = 0; // number of occurrences that were located
+    };
+    std::vector<located_match> matches; // matches of the last batch, in the order they were added
+    std::vector<size_t> occs; // text positions of the located occurrences, in increasing order for each match
+
+    size_t max_occs = 0; // occurrences located per match, 0 locates all of them
+    size_t num_matches = 0;
+    size_t num_occs = 0; // total located over all matches
+    size_t num_capped = 0; // matches with more occurrences than max_occs
+
+    MatchLocator(size_t max_occs = 0): max_occs(max_occs) {}
+
+    void add(size_t start, size_t length) {
+        /* Adds a part of the query to the next batch */
+        starts.push_back(start);
+        lengths.push_back(length);
+    }
+
+    template <class index_t>
+    void locate(index_t& index, const char* query) {
+        /* Locates the occurrences of every match added since the last batch */
+        matches.assign(starts.size(), located_match());
+        occs.clear();
+        pending.clear();
+
+        for (size_t i = 0; i < starts.size(); i++) {
+            located_match& match = matches[i];
+            size_t sample = 0;
+            match.count = index.toehold(query + starts[i], lengths[i], sample);
+            match.located = (max_occs && match.count > max_occs) ? max_occs : match.count;
+            match.first = occs.size();
+            if (match.located == 0) continue;
+
+            occs.resize(match.first + match.located);
+            occs[match.first] = sample;
+            if (match.located > 1) {pending.push_back({sample, i});}
+            num_capped += (match.located < match.count);
+        }
+
+        // each round takes one Phi step for every match that still has occurrences left
+        for (size_t step = 1; !pending.empty(); step++) {
+            std::sort(pending.begin(), pending.end());
+            size_t num_kept = 0;
+            for (const auto& entry: pending) {
+                const located_match& match = matches[entry.second];
+                size_t pos = index.Phi(entry.first);
+                occs[match.first + step] = pos;
+                if (step + 1 < match.located) {pending[num_kept++] = {pos, entry.second};}
+            }
+            pending.resize(num_kept);
+        }
+
+        for (const auto& match: matches) {
+            std::sort(occs.begin() + match.first, occs.begin() + match.first + match.located);
+        }
+        num_matches += matches.size();
+        num_occs += occs.size();
+        starts.clear();
+        lengths.clear();
+    }
+
+    void append_occs(size_t match_id, std::string& text) const {
+        /* Writes the number of occurrences of a match, and then the located ones separated by commas (* if there are more) */
+        const located_match& match = matches[match_id];
+        char buf[32];
+        int len = std::snprintf(buf, sizeof(buf), "%zu\t", match.count);
+        text.append(buf, len);
+        for (size_t i = 0; i < match.located; i++) {
+            len = std::snprintf(buf, sizeof(buf), "%s%zu", (i) ? "," : "", occs[match.first + i]);
+            text.append(buf, len);
+        }
+        if (match.located < match.count) {text.push_back('*');}
+    }
+
+    void reset_counters() {
+        num_matches = 0;
+        num_occs = 0;
+        num_capped = 0;
+    }
+
+private:
+    std::vector<size_t> starts, lengths; // matches added to the next batch
+    std::vector<std::pair<size_t, size_t>> pending; // last located position and id of each match with occurrences left
+};
+
+#endif /* End of MATCH_LOCATOR_H */
@@ -0,0 +1,118 @@
+ /*
+  * File: minimizer_digest.hpp
+  * Description: Header file for minimizer_digest.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: A MinimizerDigester keeps the hasher/encoder and output buffers
+  *       between sequences, so each thread should create one and reuse it
+  *       for all of its reads. It is not safe to share one across threads.
+  *
+  *       digest_reverse() produces the minimizers in pieces from right to
+  *       left, so backward search can consume them without the whole digested
+  *       read being written out first.
+  *
+  *       With canonical minimizers, the reverse complement of a sequence is
+  *       digested into the same minimizers in reverse order, which is what
+  *       reverse_minimizers() gives without digesting it again.
+  */
+
+#ifndef MINIMIZER_DIGEST_H
+#define MINIMIZER_DIGEST_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <encoder.h>
+
+#define DIGEST_PIECE_WINDOWS 128
+
+class MinimizerDigester {
+public:
+    MinimizerDigester(size_t k, size_t w, bool use_promotions, bool use_canonical = false);
+
+    // the encoder keeps a reference to the spacer, so it cannot be moved
+    MinimizerDigester(const MinimizerDigester&) = delete;
+    MinimizerDigester& operator=(const MinimizerDigester&) = delete;
+
+    size_t digest(const char* seq, size_t length, std::string& output);
+    size_t digest(std::string& seq);
+
+    template <typename func_t>
+    void digest_reverse(const char* seq, size_t length, func_t func);
+
+    void reverse_minimizers(const std::string& seq, std::string& rev_seq) const;
+
+private:
+    size_t k = 4; // small window size
+    size_t w = 11; // large window size
+    bool use_promotions = false; // promoted minimizers, otherwise DNA minimizers
+    bool use_canonical = false; // k-mers and their reverse complement hash the same
+
+    std::vector<uint16_t> sp_vec;
+    bns::Spacer sp;
+    bns::Encoder<bns::score::Lex, uint64_t> enc;
+    bns::RollingHasher<uint8_t> rh;
+
+    std::vector<std::string> kmer_strings; // DNA letters of each minimizer value
+    std::string buffer; // output of digest(seq) before it is swapped into seq
+    std::string piece_buffer; // minimizers of the current piece in digest_reverse()
+
+    // number of bases covered by a window (w in bonsai, the window holds w-k+1 k-mers)
+    size_t window_span = 0;
+
+    struct piece_ends {
+        int first_value = -1; // first minimizer before homopolymer compression
+        int last_value = -1; // last minimizer before homopolymer compression
+        size_t last_start = 0; // position of the last minimizer in the output
+    };
+
+    size_t digest_piece(const char* seq, size_t length, std::string& output, piece_ends& ends);
+    bool can_use_pieces(const char* seq, size_t length);
+
+    template <typename func_t>
+    void digest_pieces(const char* seq, size_t length, func_t& func);
+};
+
+template <typename func_t>
+void MinimizerDigester::digest_reverse(const char* seq, size_t length, func_t func) {
+    /* 
+     * Calls func(symbols, n) on the minimizers of the sequence in pieces from right to
+     * left, and stops if it returns false. Sequences that cannot be split safely (short
+     * or with non-ACGT characters) are digested whole, and passed in as a single piece.
+     */
+    if (!can_use_pieces(seq, length)) {
+        digest(seq, length, buffer);
+        if (buffer.length()) {func(buffer.data(), buffer.length());}
+        return;
+    }
+    digest_pieces(seq, length, func);
+}
+
+template <typename func_t>
+void MinimizerDigester::digest_pieces(const char* seq, size_t length, func_t& func) {
+    /*
+     * Each piece is a range of windows plus the bases after them that the last window
+     * covers, so it produces exactly the minimizers of those windows. The homopolymer
+     * compression is continued across pieces by dropping the last minimizer of a piece
+     * when it is equal to the first minimizer of the piece to its right.
+     */
+    size_t window_end = length - window_span + 1;
+    int right_value = -1;
+
+    while (window_end > 0) {
+        size_t window_start = (window_end > DIGEST_PIECE_WINDOWS) ? (window_end - DIGEST_PIECE_WINDOWS) : 0;
+        piece_ends ends;
+        digest_piece(seq + window_start, window_end - window_start + window_span - 1, piece_buffer, ends);
+
+        if (ends.last_value >= 0 && ends.last_value == right_value)
+            piece_buffer.resize(ends.last_start);
+        if (piece_buffer.length() && !func(piece_buffer.data(), piece_buffer.length()))
+            return;
+
+        if (ends.first_value >= 0) {right_value = ends.first_value;}
+        window_end = window_start;
+    }
+}
+
+#endif /* End of MINIMIZER_DIGEST_H */
@@ -12,6 +12,7 @@
 
 #include <common.hpp>
 #include <rle_string.hpp>
+#include <type_traits>
 
 template <class sparse_bitvector_t = ri::sparse_sd_vector, //predecessor structure storing run length
           class string_t = ri::huff_string>                //run heads
@@ -153,7 +154,61 @@ public:
         ri::rle_string<sparse_bitvector_t, string_t>::load(in);
     }
 
+    // Marker added to the index file names, the default bitvector has none
+    static std::string get_file_extension() {
+        return std::is_same<sparse_bitvector_t, ri::sparse_hyb_vector>::value ? ".hyb" : "";
+    }
+
 protected:
+    /*
+     * Reads the run-length encoded BWT, and collects the positions of the set bits
+     * in the main bitvector and each of the per-letter bitvectors. This is used by
+     * the specialized constructors, which build their bitvectors from the positions.
+     */
+    void read_run_onsets(std::ifstream &heads, std::ifstream &lengths, string &run_heads_s,
+                         std::vector<size_t> &runs_bv_onset, std::vector<std::vector<size_t>> &runs_per_letter_bv,
+                         std::vector<size_t> &runs_per_letter_bv_i) {
+        heads.clear();
+        heads.seekg(0);
+        lengths.clear();
+        lengths.seekg(0);
+
+        // Reads the run heads
+        heads.seekg(0, heads.end);
+        run_heads_s.resize(heads.tellg());
+        heads.seekg(0, heads.beg);
+        heads.read(&run_heads_s[0], run_heads_s.size());
+
+        this->n = 0;
+        this->R = run_heads_s.size();
+
+        runs_per_letter_bv = std::vector<std::vector<size_t>> (256);
+        runs_per_letter_bv_i = std::vector<size_t> (256, 0);
+
+        // Compute runs_bv and runs_per_letter_bv
+        for (size_t i = 0; i < run_heads_s.size(); ++i) {
+            size_t length = 0;
+            lengths.read((char *)&length, 5);
+            if (run_heads_s[i] <= TERMINATOR) // change 0 to 1
+                run_heads_s[i] = TERMINATOR;
+
+            if(i % this->B == this->B - 1)
+                runs_bv_onset.push_back(this->n + length - 1);
+
+            assert(length > 0);
+            runs_per_letter_bv_i[run_heads_s[i]] += length;
+            runs_per_letter_bv[run_heads_s[i]].push_back(runs_per_letter_bv_i[run_heads_s[i]] - 1);
+            this->n += length;
+        }
+
+        // Check the per-letter bitvectors cover the whole BWT
+        ulint t = 0;
+        for (ulint i = 0; i < 256; ++i) {
+            t += runs_per_letter_bv_i[i];
+        }
+        assert(t == this->n);
+    }
+
     void build_rlbwt(std::ifstream &heads, std::ifstream &lengths, ulint B) {
         heads.clear();
         heads.seekg(0);
@@ -213,60 +268,54 @@ private:
 
 // Construction from run-length encoded BWT specialization for sparse_sd_vector
 template <>
-ms_rle_string<ri::sparse_sd_vector, ri::huff_string>::ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B)
+inline ms_rle_string<ri::sparse_sd_vector, ri::huff_string>::ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B)
 { 
-    heads.clear();
-    heads.seekg(0);
-    lengths.clear();
-    lengths.seekg(0);
     this->B = B;
-
-    // Reads the run heads
     string run_heads_s;
-    heads.seekg(0, heads.end);
-    run_heads_s.resize(heads.tellg());
-    heads.seekg(0, heads.beg);
-    heads.read(&run_heads_s[0], run_heads_s.size());
-
-    size_t pos = 0;
-    this->n = 0;
-    this->R = run_heads_s.size();
+    std::vector<size_t> runs_bv_onset;
+    std::vector<std::vector<size_t>> runs_per_letter_bv;
+    std::vector<size_t> runs_per_letter_bv_i;
+    read_run_onsets(heads, lengths, run_heads_s, runs_bv_onset, runs_per_letter_bv, runs_per_letter_bv_i);
 
-    auto runs_per_letter_bv = std::vector<std::vector<size_t>> (256);
-    auto runs_per_letter_bv_i = vector<size_t> (256,0);
+    // Now compact structures
+    this->runs = ri::sparse_sd_vector(runs_bv_onset, this->n);  
+    this->runs_per_letter = std::vector<ri::sparse_sd_vector>(256);
 
-    // Runs in main bitvector
-    vector<size_t> runs_bv_onset;
-    size_t runs_bv_i = 0;
+    for (ulint i = 0; i < 256; ++i) {
+        this->runs_per_letter[i] = ri::sparse_sd_vector(runs_per_letter_bv[i], runs_per_letter_bv_i[i]);
+    }
 
-    // Compute runs_bv and runs_per_letter_bv
-    for (size_t i = 0; i < run_heads_s.size(); ++i) {
-        size_t length = 0;
-        lengths.read((char *)&length, 5);
-        if (run_heads_s[i] <= TERMINATOR) // change 0 to 1
-            run_heads_s[i] = TERMINATOR;
+    this->run_heads = ri::huff_string(run_heads_s);
+    assert(this->run_heads.size() == this->R);
+};
 
-        if(i % B == B - 1)
-            runs_bv_onset.push_back(this->n + length - 1);
+inline ri::sparse_hyb_vector build_hyb_vector(const std::vector<size_t> &onsets, size_t length) {
+    // Builds the hybrid bitvector from the positions of its set bits
+    std::vector<bool> bv (length, false);
+    for (auto pos: onsets)
+        bv[pos] = true;
+    return ri::sparse_hyb_vector(bv);
+}
 
-        assert(length > 0);
-        runs_per_letter_bv_i[run_heads_s[i]] += length;
-        runs_per_letter_bv[run_heads_s[i]].push_back(runs_per_letter_bv_i[run_heads_s[i]] - 1);
-        this->n += length;
+// Construction from run-length encoded BWT specialization for sparse_hyb_vector
+template <>
+inline ms_rle_string<ri::sparse_hyb_vector, ri::huff_string>::ms_rle_string(std::ifstream &heads, std::ifstream &lengths, ulint B)
+{
+    this->B = B;
+    string run_heads_s;
+    std::vector<size_t> runs_bv_onset;
+    std::vector<std::vector<size_t>> runs_per_letter_bv;
+    std::vector<size_t> runs_per_letter_bv_i;
+    read_run_onsets(heads, lengths, run_heads_s, runs_bv_onset, runs_per_letter_bv, runs_per_letter_bv_i);
 
-    }
-    // Now compact structures
-    ulint t = 0;
-    for (ulint i = 0; i < 256; ++i) {
-        t += runs_per_letter_bv_i[i];
-    }
-    assert(t == this->n);
-    
-    this->runs = ri::sparse_sd_vector(runs_bv_onset, this->n);  
-    this->runs_per_letter = std::vector<ri::sparse_sd_vector>(256);
+    // Each plain bitvector is allocated once at its final size, and only 
+    // one per-letter bitvector is expanded at a time
+    this->runs = build_hyb_vector(runs_bv_onset, this->n);
+    this->runs_per_letter = std::vector<ri::sparse_hyb_vector>(256);
 
     for (ulint i = 0; i < 256; ++i) {
-        this->runs_per_letter[i] = ri::sparse_sd_vector(runs_per_letter_bv[i], runs_per_letter_bv_i[i]);
+        this->runs_per_letter[i] = build_hyb_vector(runs_per_letter_bv[i], runs_per_letter_bv_i[i]);
+        std::vector<size_t>().swap(runs_per_letter_bv[i]);
     }
 
     this->run_heads = ri::huff_string(run_heads_s);
@@ -0,0 +1,47 @@
+ /*
+  * File: numa_utils.hpp
+  * Description: Header file for numa_utils.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The NUMA layout is read directly from sysfs and memory policies
+  *       are set with raw system calls so that SPUMONI does not need
+  *       to link against libnuma.
+  */
+
+#ifndef NUMA_UTILS_H
+#define NUMA_UTILS_H
+
+#include <string>
+#include <vector>
+
+struct NodeStats {
+    size_t reads = 0; // number of reads processed by threads on this node
+    size_t bases = 0; // number of bases processed by threads on this node
+};
+
+class NumaTopology {
+public:
+    std::vector<int> node_ids; // ids of the NUMA nodes that have usable cpus
+    std::vector<std::vector<int>> node_cpus; // usable cpus for each node
+
+    NumaTopology();
+
+    size_t num_nodes() const {return node_ids.size();}
+    size_t node_of_thread(size_t thread_id) const;
+    bool pin_thread(size_t thread_id) const;
+    bool pin_thread_to_node(size_t node) const;
+    bool bind_memory_to_node(size_t node) const;
+    bool interleave_memory() const;
+    static bool reset_memory_policy();
+    static int node_of_address(const void* addr);
+    static bool prefer_node_for_range(void* addr, size_t length, int node_id);
+    static std::vector<int> parse_cpu_list(const std::string& list);
+    void print_node_throughput(const char* func, const std::vector<NodeStats>& stats, double seconds) const;
+
+private:
+    bool set_memory_policy(int mode, const std::vector<int>& nodes) const;
+    static std::vector<unsigned long> build_node_mask(const std::vector<int>& nodes, unsigned long& max_bits);
+};
+
+#endif /* End of NUMA_UTILS_H */
@@ -0,0 +1,54 @@
+ /*
+  * File: prefilter.hpp
+  * Description: Header file for prefilter.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The Prefilter is a blocked Bloom filter of the q-grams in the text
+  *       that was indexed (the digested reference if minimizers are used).
+  *       Each q-gram only touches one 64-byte block, so checking a read costs
+  *       one cache miss per q-gram, which is far less than backward search.
+  *       Reads with too few q-grams in the filter cannot have long matches,
+  *       so they are classified without going through the index.
+  */
+
+#ifndef PREFILTER_H
+#define PREFILTER_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+
+#define PREFILTER_DNA_SPAN 24 // q-gram length in letters (DNA or DNA minimizers)
+#define PREFILTER_MINIMIZER_SPAN 6 // q-gram length in promoted minimizers
+#define PREFILTER_BLOCK_WORDS 8 // 512-bit blocks, one cache line each
+#define PREFILTER_MAX_HASHES 7 // each bit position uses 9 bits of a 64-bit hash
+
+class Prefilter {
+public:
+    size_t span = 0; // number of symbols in each q-gram
+    size_t num_hashes = 0; // number of bits set in a block for each q-gram
+    size_t num_blocks = 0; // number of 512-bit blocks
+    std::vector<uint64_t> blocks;
+
+    Prefilter() {} // constructor used for loading
+    Prefilter(size_t span, size_t num_items, double fp_rate);
+
+    void add(const char* seq, size_t length);
+    size_t count_hits(const char* seq, size_t length) const;
+    size_t size_in_bytes() const {return blocks.size() * sizeof(uint64_t);}
+
+    size_t serialize(std::ostream& out);
+    void load(std::istream& in);
+
+private:
+    template <typename func_t>
+    void for_each_gram(const char* seq, size_t length, func_t func) const;
+};
+
+size_t get_prefilter_span(bool use_promotions);
+void build_prefilter(const std::string& ref_file, const std::string& null_read_file, bool use_promotions,
+                     bool use_dna_letters, size_t k, size_t w, bool use_canonical, double fp_rate);
+
+#endif /* End of PREFILTER_H */
@@ -0,0 +1,94 @@
+ /*
+  * File: query_policies.hpp
+  * Description: Policies used to specialize the MS/PML query kernels
+  *              at compile-time based on the alphabet of the reads, and
+  *              the statistics that need to be reported.
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: Each alphabet policy keeps a small copy of F and the number of
+  *       occurrences of each symbol, so the inner loop of a query does
+  *       not need to touch the per-letter bitvectors to check whether a
+  *       symbol occurs in the BWT.
+  */
+
+#ifndef QUERY_POLICIES_H
+#define QUERY_POLICIES_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+enum alphabet_type {DNA_ALPHABET, MINIMIZER_ALPHABET, GENERAL_ALPHABET};
+
+/* Alphabet policies */
+struct general_alphabet {
+    /* Any byte value can occur, so keep a full table */
+    struct symbol_info {
+        uint64_t F = 0; // number of symbols in the BWT smaller than this one
+        uint64_t count = 0; // number of occurrences in the BWT
+    };
+    symbol_info symbols[256];
+
+    template <class bwt_t>
+    void init(const std::vector<uint64_t>& F, bwt_t& bwt) {
+        for (size_t c = 0; c < 256; c++) {
+            symbols[c].F = F[c];
+            symbols[c].count = bwt.number_of_letter(static_cast<uint8_t>(c));
+        }
+    }
+    inline uint64_t get_F(uint8_t c) const {return symbols[c].F;}
+    inline uint64_t count(uint8_t c) const {return symbols[c].count;}
+};
+
+// promoted minimizers use values 3 to 255 (0 to 2 are the PFP separators), which already needs the
+// full table, so they share the general kernels instead of compiling an identical copy
+using minimizer_alphabet = general_alphabet;
+
+struct dna_alphabet {
+    /*
+     * A, C, G, T and N land on distinct slots using bits 1-3 of their ASCII
+     * code, so the common symbols fit in a single cache line. Any other symbol
+     * (e.g. IUPAC codes) goes to the full table.
+     */
+    struct slot_info {
+        uint64_t F = 0;
+        uint64_t count = 0;
+        uint8_t symbol = 0;
+    };
+    slot_info slots[8];
+    general_alphabet other_symbols;
+
+    static inline size_t slot_of(uint8_t c) {return (c >> 1) & 7;}
+
+    template <class bwt_t>
+    void init(const std::vector<uint64_t>& F, bwt_t& bwt) {
+        other_symbols.init(F, bwt);
+        for (uint8_t c: {'A', 'C', 'G', 'T', 'N'}) {
+            slots[slot_of(c)].symbol = c;
+            slots[slot_of(c)].F = other_symbols.get_F(c);
+            slots[slot_of(c)].count = other_symbols.count(c);
+        }
+    }
+    inline uint64_t get_F(uint8_t c) const {
+        const slot_info& slot = slots[slot_of(c)];
+        return (slot.symbol == c) ? slot.F : other_symbols.get_F(c);
+    }
+    inline uint64_t count(uint8_t c) const {
+        const slot_info& slot = slots[slot_of(c)];
+        return (slot.symbol == c) ? slot.count : other_symbols.count(c);
+    }
+};
+
+/* Output policies */
+struct stats_output {
+    /* Only report the statistic itself (PML lengths or MS pointers) */
+    static constexpr bool report_docs = false;
+};
+
+struct doc_output {
+    /* Report the statistic, and the document of each position */
+    static constexpr bool report_docs = true;
+};
+
+#endif /* End of QUERY_POLICIES_H */
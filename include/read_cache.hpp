@@ -0,0 +1,71 @@
+ /*
+  * File: read_cache.hpp
+  * Description: Header file for read_cache.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The ReadCache keeps the MS/PML results of reads that were already
+  *       queried, so identical reads (e.g. amplicon runs) only go through the
+  *       index once. It is split into shards with their own lock and
+  *       least-recently-used list, so threads rarely wait on each other.
+  *       Results are shared (not copied) while a shard is locked.
+  */
+
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+
+#include <spumoni_main.hpp>
+#include <string>
+#include <vector>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+#define READ_CACHE_SHARDS 64
+#define READ_CACHE_ENTRY_OVERHEAD 128 // bytes used by the map/list nodes of an entry
+
+struct CachedResult {
+    std::vector<size_t> lengths; // MS or PML
+    std::vector<size_t> pointers; // MS pointers (empty for PML)
+    std::vector<size_t> doc_nums; // document numbers (empty if not requested)
+    std::string strands; // strand kept at each position (empty if only the read was queried)
+
+    size_t num_bytes() const {
+        return (lengths.size() + pointers.size() + doc_nums.size()) * sizeof(size_t) + strands.size();
+    }
+};
+
+class ReadCache {
+public:
+    ReadCache(size_t max_bytes);
+
+    ReadCache(const ReadCache&) = delete;
+    ReadCache& operator=(const ReadCache&) = delete;
+
+    std::shared_ptr<const CachedResult> find(const std::string& read);
+    void insert(const std::string& read, std::shared_ptr<const CachedResult> result);
+    void print_stats(const char* func) const;
+
+private:
+    using lru_list = std::list<std::pair<std::string, std::shared_ptr<const CachedResult>>>;
+
+    struct Shard {
+        std::mutex lock;
+        lru_list entries; // most recently used at the front
+        std::unordered_map<std::string, lru_list::iterator> index;
+        size_t num_bytes = 0;
+    };
+
+    size_t max_shard_bytes = 0;
+    Shard shards[READ_CACHE_SHARDS];
+
+    std::atomic<size_t> num_hits{0};
+    std::atomic<size_t> num_misses{0};
+    std::atomic<size_t> num_evictions{0};
+
+    Shard& shard_of(const std::string& read);
+};
+
+#endif /* End of READ_CACHE_H */
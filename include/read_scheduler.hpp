@@ -0,0 +1,82 @@
+ /*
+  * File: read_scheduler.hpp
+  * Description: Header file for read_scheduler.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The ReadScheduler hands out tasks of reads to the threads. Each
+  *       thread has its own queue of tasks, and steals from the back of
+  *       another thread's queue when its own is empty, so the input file
+  *       is only locked when every queue has run dry. Each refill is dealt
+  *       out longest task first, so long reads start early instead of
+  *       leaving one thread behind at the end. The number of bases in a
+  *       task adapts to the observed time per base, so tasks stay around
+  *       SCHED_TARGET_TASK_MS no matter how long the reads are.
+  */
+
+#ifndef READ_SCHEDULER_H
+#define READ_SCHEDULER_H
+
+#include <batch_loader.hpp>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+#define SCHED_MIN_TASK_BASES 1000
+#define SCHED_MAX_TASK_BASES 1000000
+#define SCHED_TASKS_PER_THREAD 4 // tasks per thread loaded in each refill
+#define SCHED_MAX_REFILL_BASES 64000000 // keeps refills of large tasks within memory
+#define SCHED_TARGET_TASK_MS 10.0
+#define SCHED_SMOOTHING 0.2 // weight of the newest task in the average time per base
+
+struct ReadTask {
+    std::vector<Read> reads;
+    size_t num_bases = 0;
+    size_t next_read = 0;
+
+    bool grabNextRead(Read& curr_read);
+};
+
+class ReadScheduler {
+public:
+    ReadScheduler(std::ifstream& input, size_t num_threads, size_t min_task_bases, size_t max_task_bases);
+
+    ReadScheduler(const ReadScheduler&) = delete;
+    ReadScheduler& operator=(const ReadScheduler&) = delete;
+
+    bool next_task(size_t thread_id, ReadTask& task);
+    void record_task(size_t num_bases, double seconds);
+    void print_stats(const char* func) const;
+
+private:
+    struct alignas(64) TaskQueue {
+        std::mutex lock;
+        std::deque<ReadTask> tasks;
+    };
+
+    std::ifstream& input;
+    std::mutex input_lock;
+    BatchLoader loader;
+    bool input_done = false;
+
+    size_t num_threads = 1;
+    std::unique_ptr<TaskQueue[]> queues;
+
+    size_t min_task_bases = SCHED_MIN_TASK_BASES;
+    size_t max_task_bases = SCHED_MAX_TASK_BASES;
+    std::atomic<size_t> task_bases{SCHED_MIN_TASK_BASES}; // current target size of a task
+
+    std::mutex timing_lock;
+    double ns_per_base = 0.0; // moving average over finished tasks
+
+    std::atomic<size_t> num_tasks{0};
+    std::atomic<size_t> num_steals{0};
+    std::atomic<size_t> num_refills{0};
+
+    bool pop_task(size_t thread_id, ReadTask& task);
+    bool refill(size_t thread_id);
+};
+
+#endif /* End of READ_SCHEDULER_H */
@@ -22,14 +22,15 @@ public:
     RefBuilder(const char* ref_file, const char* list_file, const char* output_file, const char* null_reads, 
                bool build_doc, bool file_list, bool use_minimizers,
                bool use_promotions, bool use_dna_letters,
-               size_t k, size_t w, bool use_rev_comp);
+               size_t k, size_t w, bool use_rev_comp, bool use_canonical);
 
     const char* get_ref_path();
     const char* get_null_readfile();
     static std::string parse_null_reads(const char* ref_file, const char* output_path);
     static std::string parse_null_reads_from_general_text(const char* ref_file, const char* output_path);
     static std::string build_reference(const char* ref_file, const char* output_path, bool use_promotions, bool use_dna_letters, 
-                                        size_t k, size_t w, bool use_rev_comp);
+                                        size_t k, size_t w, bool use_rev_comp, bool use_canonical);
+    static void reverse_complement(const std::string& seq, std::string& rc_seq);
 };// end of RefBuilder class
 
 #endif /* end of _REFBUILD_H */
\ No newline at end of file
@@ -0,0 +1,91 @@
+ /*
+  * File: run_cache.hpp
+  * Description: Small per-thread cache of the BWT runs that were
+  *              resolved in the slow path of the MS/PML queries.
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: Reads from the same organism keep landing in the same runs, so the
+  *       slow path of a query repeats the same select(), run_of_position(),
+  *       threshold and sample lookups on compressed structures. The cache is
+  *       direct-mapped on (character, rank), and each entry fits in a single
+  *       cache line with everything the slow path needs. Every thread has its
+  *       own cache, so there is no locking, and it is cleared whenever the
+  *       thread moves on to another index.
+  */
+
+#ifndef RUN_CACHE_H
+#define RUN_CACHE_H
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#define RUN_CACHE_BITS 12 // 4096 entries of 64 bytes per thread
+#define RUN_CACHE_EMPTY UINT64_MAX
+
+struct alignas(64) run_cache_entry {
+    uint64_t key = RUN_CACHE_EMPTY; // (rank << 8) | character
+    uint64_t pos = 0; // position of the character with that rank in the BWT
+    uint64_t run = 0; // run that contains that position
+    uint64_t thr = 0; // threshold of the run
+    uint64_t sample_start = RUN_CACHE_EMPTY; // SA sample at the start of the run (MS only, found when first used)
+    uint64_t sample_last = RUN_CACHE_EMPTY; // SA sample at the end of the run (MS only, found when first used)
+    uint64_t doc_start = 0; // document at the start of the run (if requested)
+    uint64_t doc_end = 0; // document at the end of the run (if requested)
+};
+
+class RunCache {
+public:
+    size_t num_hits = 0;
+    size_t num_misses = 0;
+
+    static size_t new_owner_id() {
+        /* Gives each loaded index its own id, so the cache never mixes entries from two of them */
+        static std::atomic<size_t> next_id{1};
+        return next_id++;
+    }
+
+    static RunCache& this_thread() {
+        /* Returns the cache of the calling thread */
+        thread_local RunCache cache;
+        return cache;
+    }
+
+    static RunCache& local(size_t owner_id, const void* doc_arr) {
+        /* Returns the cache of the calling thread, cleared if it was filled by another index */
+        RunCache& cache = this_thread();
+        if (cache.owner_id != owner_id || cache.owner_docs != doc_arr) {
+            cache.entries.assign(1ULL << RUN_CACHE_BITS, run_cache_entry());
+            cache.owner_id = owner_id;
+            cache.owner_docs = doc_arr;
+        }
+        return cache;
+    }
+
+    inline bool find(uint8_t c, uint64_t rank, run_cache_entry*& entry) {
+        /* Points entry to the slot of (c, rank), and returns whether it already holds that run */
+        const uint64_t key = (rank << 8) | c;
+        entry = &entries[(key * 0x9E3779B97F4A7C15ULL) >> (64 - RUN_CACHE_BITS)];
+        if (entry->key == key) {
+            num_hits++;
+            return true;
+        }
+        entry->key = key;
+        num_misses++;
+        return false;
+    }
+
+    void reset_counters() {
+        num_hits = 0;
+        num_misses = 0;
+    }
+
+private:
+    std::vector<run_cache_entry> entries;
+    size_t owner_id = 0; // index that filled the entries (0 means none)
+    const void* owner_docs = nullptr; // document array used by that index, if any
+};
+
+#endif /* End of RUN_CACHE_H */
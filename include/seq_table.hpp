@@ -0,0 +1,46 @@
+ /*
+  * File: seq_table.hpp
+  * Description: Header file for seq_table.cpp
+  *
+  * Start Date: October 16, 2026
+  *
+  * Note: The SequenceTable keeps where each reference sequence starts in
+  *       the indexed text, in sorted order, so a text position (e.g. an MS
+  *       pointer) is turned into a sequence and an offset with a binary
+  *       search. Reverse complements added during build point back to their
+  *       forward sequence, and their offsets are given on the forward strand.
+  */
+
+#ifndef SEQ_TABLE_H
+#define SEQ_TABLE_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+/* A match to be placed in the reference, and where it was found */
+struct RefCoord {
+    size_t query_pos = 0; // start of the match in the query
+    size_t length = 0; // length of the match
+    size_t text_pos = 0; // start of the match in the indexed text
+    size_t seq_id = 0; // sequence that holds the match
+    size_t offset = 0; // start of the match in that sequence, on its forward strand
+    bool reverse = false; // whether the match is on the reverse complement of the sequence
+};
+
+class SequenceTable {
+public:
+    std::vector<std::string> names; // name of each sequence, without the suffix of the reverse complement
+    std::vector<size_t> starts; // start of each sequence in the text, with the end of the text last
+    std::vector<bool> is_reverse; // whether the sequence is a reverse complement added during build
+
+    void add(const std::string& name, size_t length, bool reverse);
+    void locate(std::vector<RefCoord>& coords) const;
+    size_t num_sequences() const {return names.size();}
+
+    size_t serialize(std::ostream& out) const;
+    void load(std::istream& in);
+    static std::string get_file_extension() {return ".seqtab";}
+};
+
+#endif /* End of SEQ_TABLE_H */
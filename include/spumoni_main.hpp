@@ -78,8 +78,8 @@ bool endsWith(const std::string& str, const std::string& suffix);
 std::string execute_cmd(const char* cmd);
 size_t get_avail_phy_mem();
 int spumoni_run_usage ();
-std::string perform_minimizer_digestion(std::string input_query, size_t k, size_t w);
-std::string perform_dna_minimizer_digestion(std::string input_query, size_t k, size_t w);
+std::string perform_minimizer_digestion(const std::string& input_query, size_t k, size_t w, bool use_canonical = false);
+std::string perform_dna_minimizer_digestion(const std::string& input_query, size_t k, size_t w, bool use_canonical = false);
 
 struct SpumoniHelperPrograms {
   /* Contains paths to run helper programs */
@@ -127,6 +127,21 @@ public:
 enum output_type {MS, PML, NOT_CHOSEN};
 enum reference_type {FASTA, MINIMIZER, NOT_SET};
 enum query_input_type {FA, FQ, NOT_CLEAR};
+enum numa_mode {NUMA_OFF, NUMA_INTERLEAVE, NUMA_REPLICATE};
+enum thresholds_type {THR_BV, THR_PLAIN, THR_COMPRESSED, THR_NONE}; // THR_NONE means detect from files
+enum rlbwt_type {RLBWT_SD, RLBWT_HYB, RLBWT_NONE}; // bitvectors used in the RLBWT, RLBWT_NONE means detect
+enum vote_rule {VOTE_OFF, VOTE_SPLIT, VOTE_UNIQUE, VOTE_LOWEST, VOTE_LCA}; // how a read is assigned when documents tie
+
+std::string get_thresholds_extension(thresholds_type type);
+std::string get_thresholds_name(thresholds_type type);
+thresholds_type parse_thresholds_type(const char* name);
+std::vector<thresholds_type> parse_thresholds_list(const char* names);
+std::string get_rlbwt_extension(rlbwt_type type);
+std::string get_rlbwt_name(rlbwt_type type);
+rlbwt_type parse_rlbwt_type(const char* name);
+std::vector<rlbwt_type> parse_rlbwt_list(const char* names);
+vote_rule parse_vote_rule(const char* name);
+bool find_index_type(std::string index_prefix, output_type index_type, rlbwt_type& bwt_type, thresholds_type& thr_type);
 
 struct SpumoniBuildOptions {
   std::string output_prefix = "";
@@ -150,9 +165,15 @@ struct SpumoniBuildOptions {
   bool use_dna_letters = false; // use DNA-letter based minimizers
   bool is_general_text = false; // if input is general text (assuming it is FASTA)
   bool use_rev_comp = true; // add rev complement for FASTA files
+  bool use_canonical = false; // digest into canonical minimizers, so one strand is enough
   size_t k = 4; // small window size for minimizers
   size_t w = 11; // large window size for minimizers
   size_t bin_size = 150; // size of bins used for KS-test (for finding threshold during build)
+  std::vector<thresholds_type> thr_types = {THR_BV}; // thresholds backends to build
+  std::vector<rlbwt_type> bwt_types = {RLBWT_SD}; // RLBWT bitvectors to build
+  double prefilter_fp = 0.0; // false-positive rate of the q-gram prefilter (0 means no prefilter)
+  bool rl_doc = false; // run-length encode the document array
+  size_t ssa_rate = 0; // drop the SA samples of the MS index within this many positions of a kept one (0 keeps all)
 
 public:
   void validate() {
@@ -181,6 +202,10 @@ public:
       }
       if (build_doc && ref_file.length()) {
         FATAL_ERROR("Cannot build a document array if you are indexing a single file.");}
+      if (rl_doc && !build_doc) {
+        FATAL_ERROR("The run-length encoded document array (-L) needs the document array to be built with -d.");}
+      if (ssa_rate > 0 && !ms_index) {
+        FATAL_ERROR("Subsampling the SA samples (-s) only applies to the MS index, please add -M.");}
       
       // Check if we only set one type minimizers
       if (use_minimizers) {
@@ -199,6 +224,21 @@ public:
           FATAL_ERROR("No minimizer type should be chosen when using general text input.");
       }
 
+      // Canonical minimizers are the same on both strands, so the reverse complement is not added
+      if (use_canonical) {
+        if (!use_minimizers || is_general_text)
+          FATAL_ERROR("Canonical minimizers (-C) can only be used with minimizer digestion.");
+        use_rev_comp = false;
+      }
+
+      // The prefilter holds q-grams of FASTA references, and needs a valid false-positive rate
+      if (prefilter_fp != 0.0) {
+        if (is_general_text)
+          FATAL_ERROR("The prefilter (-F) is not available for general text input.");
+        if (prefilter_fp <= 0.0 || prefilter_fp >= 1.0)
+          FATAL_ERROR("The false-positive rate of the prefilter (-F) must be between 0 and 1.");
+      }
+
       // Make sure an output prefix is specified ...
       if (!output_prefix.length()) {
         FATAL_ERROR("Need to specify an output prefix for the index files.");
@@ -235,6 +275,23 @@ struct SpumoniRunOptions {
   size_t k = 4; // small window size for minimizers
   size_t w = 11; // large window size for minimizers
   size_t bin_size = 150; // size of region used for KS-test for classification
+  numa_mode numa_placement = NUMA_OFF; // how to place the index on multi-socket machines
+  bool use_huge_pages = false; // back the index with 2 MB pages
+  thresholds_type thr_type = THR_NONE; // thresholds backend to load (default: detect)
+  rlbwt_type bwt_type = RLBWT_NONE; // RLBWT bitvectors to load (default: detect)
+  bool both_strands = false; // query each read and its reverse complement
+  bool use_canonical = false; // digest into canonical minimizers (index built with -C)
+  size_t dedup_cache_mb = 0; // memory for the cache of duplicate reads in MB (0 means off)
+  bool suffix_batch = false; // query each batch of reads together, sharing common suffixes
+  bool reorder_reads = false; // query each batch of reads in order of their last symbols
+  size_t prefilter_hits = 0; // reads with fewer prefilter hits are not queried (0 means off)
+  size_t doc_list_length = 0; // list the documents of maximal matches at least this long (0 means off)
+  size_t doc_list_max_steps = 4096; // LF steps spent listing one match before it is cut short (0 means no bound)
+  vote_rule doc_vote = VOTE_OFF; // assign each read to a document by a weighted vote
+  size_t ref_coords_length = 0; // place maximal matches at least this long in the reference (0 means off)
+  size_t mem_length = 0; // only write maximal matches at least this long, instead of every position (0 means off)
+  bool locate_mems = false; // locate the occurrences of each MEM with Phi
+  size_t max_mem_occs = 0; // occurrences located per MEM (0 means all of them)
 
 public:
   void populate_types() {
@@ -284,20 +341,62 @@ public:
           FATAL_WARNING("For general-text querying, multi-threading is not available.");
       if (is_general_text && write_report)
           FATAL_WARNING("For general-text querying, classification is not available.");
+      if (is_general_text && numa_placement != NUMA_OFF)
+          FATAL_WARNING("For general-text querying, NUMA placement is not available.");
+      if (is_general_text && suffix_batch)
+          FATAL_WARNING("For general-text querying, suffix batching is not available.");
+      if (suffix_batch && dedup_cache_mb > 0)
+          FATAL_WARNING("Suffix batching (-B) already shares the work of duplicate reads, so it cannot be used with -D.");
+      if (is_general_text && reorder_reads)
+          FATAL_WARNING("For general-text querying, read reordering is not available.");
+      if (suffix_batch && reorder_reads)
+          FATAL_WARNING("Suffix batching (-B) already queries reads in order of their suffixes, so it cannot be used with -O.");
+      if (reorder_reads && dedup_cache_mb > 0)
+          FATAL_WARNING("Read reordering (-O) cannot be used with the duplicate read cache (-D).");
+      if (prefilter_hits > 0 && (is_general_text || suffix_batch || reorder_reads))
+          FATAL_WARNING("The prefilter (-F) checks each read on its own, so it cannot be used with -g, -B or -O.");
+      if (prefilter_hits > 0 && !is_file(ref_file + extension + ".prefilter"))
+          FATAL_WARNING("prefilter file (%s) is not present, please build it with spumoni build -F.", (ref_file+extension+".prefilter").data());
+      if (doc_vote != VOTE_OFF && !use_doc)
+          FATAL_WARNING("The document vote (-V) needs the document array, please add -d.");
+      if (doc_vote != VOTE_OFF && is_general_text)
+          FATAL_WARNING("For general-text querying, the document vote is not available.");
+      if (doc_list_length > 0 && !use_doc)
+          FATAL_WARNING("Listing the documents of each match (-l) needs the document array, please add -d.");
+      if (doc_list_length > 0 && (is_general_text || suffix_batch || reorder_reads || dedup_cache_mb > 0))
+          FATAL_WARNING("Listing the documents of each match (-l) needs each read on its own, so it cannot be used with -g, -B, -O or -D.");
+      if (ref_coords_length > 0 && result_type != MS)
+          FATAL_WARNING("Reference coordinates (-x) come from the MS pointers, so they need -M.");
+      if (ref_coords_length > 0 && (is_general_text || dedup_cache_mb > 0))
+          FATAL_WARNING("Reference coordinates (-x) cannot be used with -g or -D.");
+      if (ref_coords_length > 0 && min_digest)
+          FATAL_WARNING("Reference coordinates (-x) are in bases, so they need an index built and queried without minimizers (-n).");
+      if (ref_coords_length > 0 && !is_file(ref_file + extension + ".seqtab"))
+          FATAL_WARNING("sequence table (%s) is not present, please rebuild the index with spumoni build.", (ref_file+extension+".seqtab").data());
+      if (mem_length > 0 && result_type != MS)
+          FATAL_WARNING("MEM records (-e) come from the MS lengths and pointers, so they need -M.");
+      if (mem_length > 0 && (is_general_text || dedup_cache_mb > 0))
+          FATAL_WARNING("MEM records (-e) are found on each strand on its own, so they cannot be used with -g or -D.");
+      if (locate_mems && mem_length == 0)
+          FATAL_WARNING("Locating the occurrences of each MEM (-o) needs the MEM records, please add -e.");
+      if (is_general_text && dedup_cache_mb > 0)
+          FATAL_WARNING("For general-text querying, the duplicate read cache is not available.");
+      if (is_general_text && both_strands)
+          FATAL_WARNING("For general-text querying, reverse complement querying is not available.");
+      if (use_canonical && !min_digest)
+          FATAL_WARNING("Canonical minimizers (-C) can only be used with minimizer digestion.");
       
       // Verify doc array is available, if needed
-      if (use_doc && !is_file(ref_file+extension+".doc")) 
-        FATAL_WARNING("document array file (%s) is not present, so it cannot be used.", (ref_file+extension+".doc").data());
+      if (use_doc && !is_file(ref_file+extension+".doc") && !is_file(ref_file+extension+".rldoc")) 
+        FATAL_WARNING("document array file (%s or .rldoc) is not present, so it cannot be used.", (ref_file+extension+".doc").data());
       
-      switch (result_type) {
-        case MS: 
-            if (!is_file(ref_file+extension+".thrbv.ms")) 
-            {FATAL_WARNING("The index required for this computation is not available, please use spumoni build.");} break;
-        case PML:
-            if (!is_file(ref_file+extension+".thrbv.spumoni")) 
-            {FATAL_WARNING("The index required for this computation is not available, please use spumoni build.");} break;
-        default:
-            FATAL_WARNING("An output type with -M or -P must be specified, only one can be used at a time."); break;
+      // Verify the index is available, either with the requested RLBWT/thresholds or any of them
+      rlbwt_type found_bwt_type = bwt_type;
+      thresholds_type found_thr_type = thr_type;
+      if (!find_index_type(ref_file+extension, result_type, found_bwt_type, found_thr_type)) {
+          if (bwt_type != RLBWT_NONE || thr_type != THR_NONE)
+              FATAL_WARNING("The index with the requested RLBWT (-R) and thresholds (-T) is not available, please use spumoni build.");
+          FATAL_WARNING("The index required for this computation is not available, please use spumoni build.");
       }
 
       // Check the values for k and w
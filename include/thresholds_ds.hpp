@@ -127,7 +127,7 @@ public:
         swap(*this, other);
     }
 
-    size_t operator[] (size_t& i)
+    size_t operator[] (size_t i)
     {
         assert( i < thresholds.size());
         return thresholds[i];
@@ -156,7 +156,7 @@ public:
         bwt = bwt_;
     }
 
-    std::string get_file_extension() const
+    static std::string get_file_extension()
     {
         return ".thrp";
     }
@@ -314,7 +314,7 @@ public:
         swap(*this, other);
     }
 
-    size_t operator[] (size_t& i)
+    size_t operator[] (size_t i)
     {
         assert( i < thresholds.size());
 
@@ -360,7 +360,7 @@ public:
         bwt = bwt_;
     }
 
-    std::string get_file_extension() const
+    static std::string get_file_extension()
     {
         return ".thrc";
     }
@@ -522,7 +522,7 @@ public:
         bwt = bwt_;
     }
 
-    std::string get_file_extension() const
+    static std::string get_file_extension()
     {
         return ".thrbv";
     }
@@ -24,6 +24,23 @@
 #include <ks_test.hpp>
 #include <omp.h>
 #include <batch_loader.hpp>
+#include <read_scheduler.hpp>
+#include <numa_utils.hpp>
+#include <hugepage_utils.hpp>
+#include <cpu_dispatch.hpp>
+#include <query_policies.hpp>
+#include <minimizer_digest.hpp>
+#include <refbuilder.hpp>
+#include <read_cache.hpp>
+#include <run_cache.hpp>
+#include <prefilter.hpp>
+#include <doc_listing.hpp>
+#include <doc_vote.hpp>
+#include <seq_table.hpp>
+#include <match_locator.hpp>
+#include <thread>
+#include <variant>
+#include <random>
 
 /*
  * This first section of the code contains classes that define pml_pointers
@@ -39,6 +56,7 @@ public:
     thresholds_t thresholds;
     typedef size_t size_type;
     size_t num_runs;
+    size_t run_cache_id = RunCache::new_owner_id(); // identifies this index in the per-thread run caches
 
     pml_pointers() {}
     pml_pointers(std::string filename, bool rle = false) : ri::r_index<sparse_bv_type, rle_string_t>() {    
@@ -79,6 +97,7 @@ public:
         //SPUMONI_LOG("log2(n/r) = %.4f", log2(double(this->bwt.size()) / this->r));
 
         thresholds = thresholds_t(filename,&this->bwt);
+        build_alphabets();
     }
 
     void read_samples(std::string filename, ulint r, ulint n, int_vector<> &samples) {
@@ -148,15 +167,90 @@ public:
 
     /*
      * Overloaded functions - based on wheter you want to report the
-     * document numbers or not.
+     * document numbers or not. These use the general alphabet, the
+     * specialized kernels can be called with the template below.
      */
     void query(const char* pattern, const size_t m, std::vector<size_t>& lengths) {
-        _query(pattern, m, lengths);
+        std::vector<size_t> doc_nums;
+        query<general_alphabet, stats_output>(pattern, m, lengths, doc_nums, nullptr);
     }
 
     void query(const char* pattern, const size_t m, std::vector<size_t>& lengths,
                               std::vector<size_t>& doc_nums, DocumentArray& doc_arr) {
-        _query(pattern, m, lengths, doc_nums, doc_arr);
+        query<general_alphabet, doc_output>(pattern, m, lengths, doc_nums, &doc_arr);
+    }
+
+    template <class alphabet_t, class output_t>
+    void query(const char* pattern, const size_t m, std::vector<size_t>& lengths,
+               std::vector<size_t>& doc_nums, const DocumentArray* doc_arr) {
+        lengths.resize(m);
+        if (output_t::report_docs) {doc_nums.resize(m);}
+
+        query_state state = initial_state(doc_arr);
+        _query<alphabet_t, output_t>(pattern, m, std::get<alphabet_t>(alphabets), lengths.data(),
+                                     doc_nums.data(), doc_arr, state, run_cache(doc_arr));
+    }
+
+    template <class alphabet_t, class output_t>
+    void streaming_query(MinimizerDigester& digester, const char* read, const size_t read_length,
+                         std::vector<size_t>& lengths, std::vector<size_t>& doc_nums, const DocumentArray* doc_arr) {
+        /*
+         * Digests the read from right-to-left, and feeds each piece of minimizers
+         * straight into the kernel, so the digested read is never written out. The
+         * pieces are stored in reverse, so the output is flipped once at the end.
+         */
+        lengths.clear();
+        if (output_t::report_docs) {doc_nums.clear();}
+
+        query_state state = initial_state(doc_arr);
+        const alphabet_t& alphabet = std::get<alphabet_t>(alphabets);
+        RunCache& cache = run_cache(doc_arr);
+
+        digester.digest_reverse(read, read_length, [&](const char* piece, size_t m) {
+            size_t offset = lengths.size();
+            lengths.resize(offset + m);
+            if (output_t::report_docs) {doc_nums.resize(offset + m);}
+
+            _query<alphabet_t, output_t>(piece, m, alphabet, lengths.data() + offset,
+                                         (output_t::report_docs) ? doc_nums.data() + offset : nullptr, doc_arr, state, cache);
+            std::reverse(lengths.begin() + offset, lengths.end());
+            if (output_t::report_docs) {std::reverse(doc_nums.begin() + offset, doc_nums.end());}
+            return true;
+        });
+        std::reverse(lengths.begin(), lengths.end());
+        if (output_t::report_docs) {std::reverse(doc_nums.begin(), doc_nums.end());}
+    }
+
+    struct query_state {
+        ulint pos = 0; // current position in the BWT
+        size_t length = 0; // PML of the last position processed
+        size_t doc = 0; // document of the last position processed
+    };
+
+    query_state initial_state(const DocumentArray* doc_arr) {
+        /* State before any character is processed, i.e. the empty string */
+        query_state state;
+        state.pos = this->bwt_size() - 1;
+        if (doc_arr != nullptr) {state.doc = doc_arr->end_doc(this->bwt.number_of_runs()-1);}
+        return state;
+    }
+
+    template <class alphabet_t, class output_t>
+    void query_piece(const char* piece, const size_t m, size_t* lengths, size_t* doc_nums,
+                     const DocumentArray* doc_arr, query_state& state, RunCache& cache) {
+        /* Processes one piece of a longer pattern, continuing from the state left by the piece after it */
+        _query<alphabet_t, output_t>(piece, m, std::get<alphabet_t>(alphabets), lengths, doc_nums, doc_arr, state, cache);
+    }
+
+    RunCache& run_cache(const DocumentArray* doc_arr) {
+        /* Returns the run cache of the calling thread for this index, fetched once per read or batch */
+        return RunCache::local(run_cache_id, doc_arr);
+    }
+
+    void build_alphabets() {
+        /* Fills in the lookup tables used by each alphabet policy */
+        std::get<dna_alphabet>(alphabets).init(this->F, this->bwt);
+        std::get<general_alphabet>(alphabets).init(this->F, this->bwt);
     }
 
     void print_stats(){
@@ -186,6 +280,16 @@ public:
         return l;
     }
 
+    ulint LF(ri::ulint i) {
+        /* Backward step from position i, using the symbol at that position */
+        return LF(i, this->bwt[i]);
+    }
+
+    void list_documents(const char* pattern, size_t m, const DocumentArray& doc_arr, DocumentLister& lister) {
+        /* Lists every document that contains the pattern, the documents are left in the lister */
+        lister.list(this->bwt, this->F, pattern, m, doc_arr);
+    }
+
     /* serialize the structure to the ostream
      * \param out     the ostream
      */
@@ -204,8 +308,8 @@ public:
         return written_bytes;
     }
 
-    std::string get_file_extension() const {
-        return thresholds.get_file_extension() + ".spumoni";
+    static std::string get_file_extension() {
+        return rle_string_t::get_file_extension() + thresholds_t::get_file_extension() + ".spumoni";
     }
 
     /* load the structure from the istream
@@ -218,117 +322,85 @@ public:
 
         this->r = this->bwt.number_of_runs();
         thresholds.load(in,&this->bwt);
+        build_alphabets();
+        run_cache_id = RunCache::new_owner_id();
     }
 
 
 protected:
-    /*
-     * Overloaded functions - based on whether you want to report the
-     * document numbers or not.
-     */
-    template<typename string_t>
-    void _query(const string_t &pattern, const size_t m, std::vector<size_t>& lengths) {
-        // Actual PML computation method
-        lengths.resize(m);
-
-        // Start with the empty string
-        auto pos = this->bwt_size() - 1;
-        auto length = 0;
-
-        for (size_t i = 0; i < m; ++i) {
-            auto c = pattern[m - i - 1];
-
-            if (this->bwt.number_of_letter(c) == 0){length = 0;}
-            else if (pos < this->bwt.size() && this->bwt[pos] == c) {length++;}
-            else {
-                // Get threshold
-                ri::ulint rnk = this->bwt.rank(pos, c);
-                size_t thr = this->bwt.size() + 1;
-
-                ulint next_pos = pos;
-
-                // if (rnk < (this->F[c] - this->F[c-1]) // I can use F to compute it
-                if (rnk < this->bwt.number_of_letter(c)) {
-
-                    // j is the first position of the next run of c's
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
-
-                    thr = thresholds[run_of_j]; // If it is the first run thr = 0
-                    length = 0;
-                    next_pos = j;
-                }
-
-                if (pos < thr) {
-                    rnk--;
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
-
-                    length = 0;
-                    next_pos = j;
-                }
-                pos = next_pos;
-            }
-
-            lengths[m - i - 1] = length;
-
-            // Perform one backward step
-            pos = LF(pos, c);
+    std::tuple<dna_alphabet, general_alphabet> alphabets;
+
+    const run_cache_entry& lookup_run(RunCache& cache, uint8_t c, ri::ulint rnk, const DocumentArray* doc_arr) {
+        /* Resolves the run that holds the c with the given rank, or takes it from the cache if it was seen before */
+        run_cache_entry* entry = nullptr;
+        if (cache.find(c, rnk, entry)) return *entry;
+
+        entry->pos = this->bwt.select(rnk, c);
+        entry->run = this->bwt.run_of_position(entry->pos);
+        entry->thr = thresholds[entry->run]; // If it is the first run thr = 0
+        if (doc_arr != nullptr) {
+            entry->doc_start = doc_arr->start_doc(entry->run);
+            entry->doc_end = doc_arr->end_doc(entry->run);
         }
+        return *entry;
     }
 
-    template<typename string_t>
-    void _query(const string_t &pattern, const size_t m, std::vector<size_t>& lengths,
-                std::vector<size_t>& doc_nums, DocumentArray& doc_arr) {
-        // Actual PML computation method
-        lengths.resize(m);
-        doc_nums.resize(m);
-
-        // Start with the empty string
-        auto pos = this->bwt_size() - 1;
-        auto length = 0;
-        size_t curr_doc_id = doc_arr.end_runs_doc[this->bwt.number_of_runs()-1];
-
-        for (size_t i = 0; i < m; ++i) {
-            auto c = pattern[m - i - 1];
-
-            if (this->bwt.number_of_letter(c) == 0){length = 0;}
-            else if (pos < this->bwt.size() && this->bwt[pos] == c) {length++;}
+    /*
+     * Actual PML computation method, it is specialized at compile-time on the
+     * alphabet of the pattern and whether the document numbers are needed. The
+     * pattern is processed right-to-left starting from the given state, and the
+     * state is updated so a longer pattern can be processed in pieces.
+     */
+    template <class alphabet_t, class output_t>
+    void _query(const char* pattern, const size_t m, const alphabet_t& alphabet, size_t* lengths,
+                size_t* doc_nums, const DocumentArray* doc_arr, query_state& state, RunCache& cache) {
+        const ulint n = this->bwt.size();
+        ulint pos = state.pos;
+        size_t length = state.length;
+        size_t curr_doc_id = state.doc;
+
+        for (size_t i = m; i-- > 0;) {
+            const uint8_t c = static_cast<uint8_t>(pattern[i]);
+            const ulint num_c = alphabet.count(c);
+
+            if (num_c == 0) {length = 0;}
+            else if (pos < n && this->bwt[pos] == c) {length++;}
             else {
                 // Get threshold
                 ri::ulint rnk = this->bwt.rank(pos, c);
-                size_t thr = this->bwt.size() + 1;
+                size_t thr = n + 1;
                 ulint next_pos = pos;
 
-                if (rnk < this->bwt.number_of_letter(c)) {
-                    // j is the first position of the next run of c's
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
-
-                    thr = thresholds[run_of_j]; // If it is the first run thr = 0
-                    curr_doc_id = doc_arr.start_runs_doc[run_of_j];
+                if (rnk < num_c) {
+                    // first position of the next run of c's
+                    const run_cache_entry& next_run = lookup_run(cache, c, rnk, doc_arr);
+                    thr = next_run.thr;
+                    if (output_t::report_docs) {curr_doc_id = next_run.doc_start;}
 
                     length = 0;
-                    next_pos = j;
+                    next_pos = next_run.pos;
                 }
 
                 if (pos < thr) {
                     rnk--;
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
-                    curr_doc_id = doc_arr.end_runs_doc[run_of_j];
+                    const run_cache_entry& prev_run = lookup_run(cache, c, rnk, doc_arr);
+                    if (output_t::report_docs) {curr_doc_id = prev_run.doc_end;}
 
                     length = 0;
-                    next_pos = j;
+                    next_pos = prev_run.pos;
                 }
                 pos = next_pos;
             }
 
-            lengths[m-i-1] = length;
-            doc_nums[m-i-1] = curr_doc_id;
+            lengths[i] = length;
+            if (output_t::report_docs) {doc_nums[i] = curr_doc_id;}
+
             // Perform one backward step
-            pos = LF(pos, c);
+            pos = alphabet.get_F(c) + this->bwt.rank(pos, c);
         }
+        state.pos = pos;
+        state.length = length;
+        state.doc = curr_doc_id;
     }
 }; /* End of pml_pointers class */
 
@@ -342,7 +414,19 @@ public:
     thresholds_t thresholds;
     int_vector<> samples_start;
     typedef size_t size_type;
+
+    // text positions sampled at the start of each run in text order, and their runs, for Phi
+    sdsl::sd_vector<> phi_start_marks;
+    sdsl::sd_vector<>::rank_1_type phi_start_rank;
+    sdsl::sd_vector<>::select_1_type phi_start_select;
+    int_vector<> phi_start_runs;
+
+    // with subsampling, only the samples of the runs marked here are stored, the rest are found with LF steps
+    size_t ssa_rate = 0;
+    sdsl::sd_vector<> kept_start, kept_last;
+    sdsl::sd_vector<>::rank_1_type kept_start_rank, kept_last_rank;
     size_t num_runs;
+    size_t run_cache_id = RunCache::new_owner_id(); // identifies this index in the per-thread run caches
 
     ms_pointers() {}
 
@@ -391,6 +475,7 @@ public:
 
         // Reading in the thresholds
         thresholds = thresholds_t(filename, &this->bwt);
+        build_alphabets();
     }
 
     void read_samples(std::string filename, ulint r, ulint n, int_vector<> &samples) {
@@ -462,17 +547,63 @@ public:
 
     /*
      * Overloaded functions - based on whether you want to report the document 
-     * numbers as well or not.
+     * numbers as well or not. These use the general alphabet, the specialized
+     * kernels can be called with the template below.
      */
     void query(const char* pattern, const size_t m, std::vector<size_t>& pointers) {
-        _query(pattern, m, pointers);
+        std::vector<size_t> doc_nums;
+        query<general_alphabet, stats_output>(pattern, m, pointers, doc_nums, nullptr);
     }
 
     void query(const char* pattern, const size_t m, std::vector<size_t>& pointers, std::vector<size_t>& doc_nums,
                DocumentArray& doc_array){
-        _query(pattern, m, pointers, doc_nums, doc_array);
+        query<general_alphabet, doc_output>(pattern, m, pointers, doc_nums, &doc_array);
     } 
 
+    template <class alphabet_t, class output_t>
+    void query(const char* pattern, const size_t m, std::vector<size_t>& pointers,
+               std::vector<size_t>& doc_nums, const DocumentArray* doc_arr) {
+        pointers.resize(m);
+        if (output_t::report_docs) {doc_nums.resize(m);}
+
+        query_state state = initial_state(doc_arr);
+        _query<alphabet_t, output_t>(pattern, m, std::get<alphabet_t>(alphabets), pointers.data(),
+                                     doc_nums.data(), doc_arr, state, run_cache(doc_arr));
+    }
+
+    struct query_state {
+        ulint pos = 0; // current position in the BWT
+        ulint sample = 0; // MS pointer of the last position processed
+        size_t doc = 0; // document of the last position processed
+    };
+
+    query_state initial_state(const DocumentArray* doc_arr) {
+        /* State before any character is processed, i.e. the empty string */
+        query_state state;
+        state.pos = this->bwt_size() - 1;
+        state.sample = this->get_last_run_sample();
+        if (doc_arr != nullptr) {state.doc = doc_arr->end_doc(this->bwt.number_of_runs()-1);}
+        return state;
+    }
+
+    template <class alphabet_t, class output_t>
+    void query_piece(const char* piece, const size_t m, size_t* pointers, size_t* doc_nums,
+                     const DocumentArray* doc_arr, query_state& state, RunCache& cache) {
+        /* Processes one piece of a longer pattern, continuing from the state left by the piece after it */
+        _query<alphabet_t, output_t>(piece, m, std::get<alphabet_t>(alphabets), pointers, doc_nums, doc_arr, state, cache);
+    }
+
+    RunCache& run_cache(const DocumentArray* doc_arr) {
+        /* Returns the run cache of the calling thread for this index, fetched once per read or batch */
+        return RunCache::local(run_cache_id, doc_arr);
+    }
+
+    void build_alphabets() {
+        /* Fills in the lookup tables used by each alphabet policy */
+        std::get<dna_alphabet>(alphabets).init(this->F, this->bwt);
+        std::get<general_alphabet>(alphabets).init(this->F, this->bwt);
+    }
+
     std::pair<ulint, ulint> get_bwt_stats() {
         return std::make_pair(this->bwt_size() , this->bwt.number_of_runs());
     }
@@ -487,6 +618,9 @@ public:
         verbose("          samples_last: ", this->samples_last.serialize(ns));
         verbose("            thresholds: ", thresholds.serialize(ns));
         verbose("         samples_start: ", samples_start.serialize(ns));
+        if (ssa_rate > 0) {
+            verbose("    kept samples marks: ", kept_start.serialize(ns) + kept_last.serialize(ns));
+        }
     }
 
     //
@@ -503,6 +637,109 @@ public:
         return l;
     }
 
+    ulint LF(ri::ulint i) {
+        /* Backward step from position i, using the symbol at that position */
+        return LF(i, this->bwt[i]);
+    }
+
+    void list_documents(const char* pattern, size_t m, const DocumentArray& doc_arr, DocumentLister& lister) {
+        /* Lists every document that contains the pattern, the documents are left in the lister */
+        lister.list(this->bwt, this->F, pattern, m, doc_arr);
+    }
+
+    void build_phi() {
+        /* 
+         * Builds the support for Phi from the samples at the starts of the runs, it is not stored
+         * in the index since only locating needs it. The samples are kept one position to the
+         * left (SA-1), so they are shifted back to text positions first. The marks need every
+         * sample, so subsampled indexes cannot be used for locating.
+         */
+        if (ssa_rate > 0) {FATAL_ERROR("Phi needs all the SA samples, so it cannot be built for a subsampled index.");}
+        build_phi_marks(samples_start, this->bwt.size(), phi_start_marks, phi_start_runs);
+
+        phi_start_rank = sdsl::sd_vector<>::rank_1_type(&phi_start_marks);
+        phi_start_select = sdsl::sd_vector<>::select_1_type(&phi_start_marks);
+    }
+
+    size_t phi_size_in_bytes() const {
+        /* Returns the memory used by the Phi support */
+        return sdsl::size_in_bytes(phi_start_marks) + sdsl::size_in_bytes(phi_start_runs);
+    }
+
+    ulint Phi(ulint pos) {
+        /* 
+         * Returns the text position of the suffix before the one at pos in the BWT (n for the first one). The
+         * closest run start to the left in the text has the same distance to the end of the previous run.
+         */
+        const ulint n = this->bwt.size();
+        ulint k = phi_start_rank(pos + 1);
+        if (k == 0) {k = phi_start_runs.size();} // the predecessor wraps around the text
+        ulint mark = phi_start_select(k), run = phi_start_runs[k-1];
+        if (run == 0) return n;
+        return ((get_sample_last(run-1) + 1) + (pos + n - mark)) % n;
+    }
+
+    size_t toehold(const char* pattern, size_t m, size_t& sample) {
+        /* 
+         * Backward search for the pattern that also keeps the text position of the last suffix in
+         * its range (the toehold), and returns the number of occurrences. When the last suffix does
+         * not extend with the next character, the range ends at the last run of that character.
+         */
+        ulint sp = 0, ep = this->bwt.size() - 1;
+        sample = this->get_last_run_sample();
+        for (size_t i = m; i-- > 0;) {
+            const uint8_t c = static_cast<uint8_t>(pattern[i]);
+            ulint rank_ep = this->bwt.rank(ep + 1, c);
+            ulint next_sp = this->F[c] + this->bwt.rank(sp, c), next_end = this->F[c] + rank_ep;
+            if (next_end <= next_sp) return 0;
+
+            if (this->bwt[ep] == c) {sample--;}
+            else {sample = get_sample_last(this->bwt.run_of_position(this->bwt.select(rank_ep - 1, c)));}
+            sp = next_sp;
+            ep = next_end - 1;
+        }
+        return ep - sp + 1;
+    }
+
+    ulint get_sample_start(ulint run) {
+        /* Returns the sample at the start of a run (SA-1), finding it with LF steps if it was subsampled */
+        if (ssa_rate == 0) return samples_start[run];
+        if (kept_start[run]) return samples_start[kept_start_rank(run)];
+        return find_sample(this->bwt.run_range(run).first);
+    }
+
+    ulint get_sample_last(ulint run) {
+        /* Returns the sample at the end of a run (SA-1), finding it with LF steps if it was subsampled */
+        if (ssa_rate == 0) return this->samples_last[run];
+        if (kept_last[run]) return this->samples_last[kept_last_rank(run)];
+        return find_sample(this->bwt.run_range(run).second);
+    }
+
+    ulint get_last_run_sample() {
+        /* Returns the text position of the last suffix in the BWT */
+        return (get_sample_last(this->r - 1) + 1) % this->bwt.size();
+    }
+
+    void subsample(size_t rate) {
+        /* 
+         * Drops each sample that is at most rate positions after the previous sample kept, in text
+         * order, so a dropped sample is found in at most rate LF steps. The sample at the end of the
+         * last run is always kept, since it starts every query.
+         */
+        ssa_rate = rate;
+        subsample_samples(samples_start, rate, kept_start);
+        subsample_samples(this->samples_last, rate, kept_last, this->r - 1);
+        kept_start_rank = sdsl::sd_vector<>::rank_1_type(&kept_start);
+        kept_last_rank = sdsl::sd_vector<>::rank_1_type(&kept_last);
+    }
+
+    size_t samples_size_in_bytes() const {
+        /* Returns the memory used by the samples, along with the marks of the kept ones if subsampled */
+        size_t samples_bytes = sdsl::size_in_bytes(samples_start) + sdsl::size_in_bytes(this->samples_last);
+        if (ssa_rate > 0) {samples_bytes += sdsl::size_in_bytes(kept_start) + sdsl::size_in_bytes(kept_last);}
+        return samples_bytes;
+    }
+
       // serialize the structure to the ostream
      // \param out     the ostream
      //
@@ -522,12 +759,20 @@ public:
         // written_bytes += my_serialize(samples_start, out, child, "samples_start");
         written_bytes += samples_start.serialize(out, child, "samples_start");
 
+        // the subsampling is written last, so indexes without it still load
+        if (ssa_rate > 0) {
+            out.write((char *)&ssa_rate, sizeof(ssa_rate));
+            written_bytes += sizeof(ssa_rate);
+            written_bytes += kept_start.serialize(out, child, "kept_start");
+            written_bytes += kept_last.serialize(out, child, "kept_last");
+        }
+
         sdsl::structure_tree::add_size(child, written_bytes);
         return written_bytes;
     }
 
-    std::string get_file_extension() const {
-        return thresholds.get_file_extension() + ".ms";
+    static std::string get_file_extension() {
+        return rle_string_t::get_file_extension() + thresholds_t::get_file_extension() + ".ms";
     }
 
     // load the structure from the istream
@@ -544,136 +789,409 @@ public:
         // my_load(thresholds, in);
         samples_start.load(in);
         // my_load(samples_start,in);
+
+        ssa_rate = 0;
+        if (in.peek() != EOF) {
+            in.read((char *)&ssa_rate, sizeof(ssa_rate));
+            kept_start.load(in);
+            kept_last.load(in);
+            kept_start_rank = sdsl::sd_vector<>::rank_1_type(&kept_start);
+            kept_last_rank = sdsl::sd_vector<>::rank_1_type(&kept_last);
+        }
+        build_alphabets();
+        run_cache_id = RunCache::new_owner_id();
     }
 
 
 protected:
-    /*
-     * Overloaded functions - based on whether you want to get the document 
-     * numbers or not.
-     */
-    template<typename string_t>
-    void _query(const string_t &pattern, const size_t m, std::vector<size_t>& ms_pointers) {
-        // Actual MS Computation
-        ms_pointers.resize(m);
-        auto pos = this->bwt_size() - 1;
-        auto sample = this->get_last_run_sample();
-
-        for (size_t i = 0; i < m; ++i) 
-        {
-            auto c = pattern[m - i - 1];
+    std::tuple<dna_alphabet, general_alphabet> alphabets;
+
+    run_cache_entry& lookup_run(RunCache& cache, uint8_t c, ri::ulint rnk, const DocumentArray* doc_arr) {
+        /* 
+         * Resolves the run that holds the c with the given rank, or takes it from the cache if it was
+         * seen before. The samples are left to the first use, since only one of them is needed per
+         * lookup and a subsampled one costs LF steps.
+         */
+        run_cache_entry* entry = nullptr;
+        if (cache.find(c, rnk, entry)) return *entry;
+
+        entry->pos = this->bwt.select(rnk, c);
+        entry->run = this->bwt.run_of_position(entry->pos);
+        entry->thr = thresholds[entry->run]; // If it is the first run thr = 0
+
+        entry->sample_start = RUN_CACHE_EMPTY;
+        entry->sample_last = RUN_CACHE_EMPTY;
+        if (doc_arr != nullptr) {
+            entry->doc_start = doc_arr->start_doc(entry->run);
+            entry->doc_end = doc_arr->end_doc(entry->run);
+        }
+        return *entry;
+    }
 
-            if (this->bwt.number_of_letter(c) == 0){sample = 0;}
-            else if (pos < this->bwt.size() && this->bwt[pos] == c){sample--;}
-            else {
-                // Get threshold
-                ri::ulint rnk = this->bwt.rank(pos, c);
-                size_t thr = this->bwt.size() + 1;
+    inline ulint entry_sample_start(run_cache_entry& entry) {
+        /* Returns the sample at the start of the cached run, finding it on first use */
+        if (entry.sample_start == RUN_CACHE_EMPTY) {entry.sample_start = get_sample_start(entry.run);}
+        return entry.sample_start;
+    }
 
-                ulint next_pos = pos;
+    inline ulint entry_sample_last(run_cache_entry& entry) {
+        /* Returns the sample at the end of the cached run, finding it on first use */
+        if (entry.sample_last == RUN_CACHE_EMPTY) {entry.sample_last = get_sample_last(entry.run);}
+        return entry.sample_last;
+    }
 
-                // if (rnk < (this->F[c] - this->F[c-1]) // I can use F to compute it
-                if (rnk < this->bwt.number_of_letter(c)) {
+    ulint find_sample(ulint pos) {
+        /* 
+         * Takes LF steps from a run boundary until it reaches a boundary with a kept sample. Each
+         * step moves one position to the left in the text, so the sample is the one found plus the
+         * number of steps, and subsampling ensures there are at most ssa_rate of them.
+         */
+        const ulint n = this->bwt.size();
+        for (ulint steps = 1; steps <= ssa_rate; steps++) {
+            pos = LF(pos);
+            ulint run = this->bwt.run_of_position(pos);
+            auto run_range = this->bwt.run_range(run);
+            if (pos == run_range.second && kept_last[run]) {return (this->samples_last[kept_last_rank(run)] + steps) % n;}
+            if (pos == run_range.first && kept_start[run]) {return (samples_start[kept_start_rank(run)] + steps) % n;}
+        }
+        FATAL_ERROR("A subsampled SA sample was not found within %ld LF steps, the index may be corrupted.", ssa_rate);
+        return 0;
+    }
 
-                    // j is the first position of the next run of c's
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
+    static void subsample_samples(int_vector<>& samples, size_t rate, sdsl::sd_vector<>& kept, size_t always_kept = SIZE_MAX) {
+        /* Marks the samples that are kept, and removes the others from the vector (always_kept is a run that is never dropped) */
+        std::vector<std::pair<ulint, ulint>> sorted_samples(samples.size());
+        for (size_t run = 0; run < samples.size(); run++) {sorted_samples[run] = {samples[run], run};}
+        std::sort(sorted_samples.begin(), sorted_samples.end());
+
+        sdsl::bit_vector keep(samples.size(), 0);
+        for (size_t i = 0, last_kept = 0; i < sorted_samples.size(); i++) {
+            if (i == 0 || sorted_samples[i].first - last_kept > rate) {
+                keep[sorted_samples[i].second] = 1;
+                last_kept = sorted_samples[i].first;
+            }
+        }
+        if (always_kept < samples.size()) {keep[always_kept] = 1;}
 
-                    thr = thresholds[run_of_j]; // If it is the first run thr = 0
+        size_t num_kept = 0;
+        for (size_t run = 0; run < samples.size(); run++) {num_kept += keep[run];}
+        int_vector<> kept_samples(num_kept, 0, samples.width());
+        for (size_t run = 0, i = 0; run < samples.size(); run++) {
+            if (keep[run]) {kept_samples[i++] = samples[run];}
+        }
+        kept = sdsl::sd_vector<>(keep);
+        samples = kept_samples;
+    }
 
-                    // Here we should use Phi_inv that is not implemented yet
-                    // sample = this->Phi(this->samples_last[run_of_j - 1]) - 1;
-                    sample = samples_start[run_of_j];
+    static void build_phi_marks(const int_vector<>& samples, ulint n, sdsl::sd_vector<>& marks, int_vector<>& runs) {
+        /* Marks the text position of each sample, and keeps the run of each mark in text order */
+        std::vector<std::pair<ulint, ulint>> sorted_samples(samples.size());
+        for (size_t run = 0; run < samples.size(); run++) {sorted_samples[run] = {(samples[run] + 1) % n, run};}
+        std::sort(sorted_samples.begin(), sorted_samples.end());
+
+        std::vector<ulint> positions(sorted_samples.size());
+        runs = int_vector<>(sorted_samples.size(), 0, bitsize(uint64_t(samples.size())));
+        for (size_t i = 0; i < sorted_samples.size(); i++) {
+            positions[i] = sorted_samples[i].first;
+            runs[i] = sorted_samples[i].second;
+        }
+        marks = sdsl::sd_vector<>(positions.begin(), positions.end());
+    }
+
+    /*
+     * Actual MS computation method, it is specialized at compile-time on the
+     * alphabet of the pattern and whether the document numbers are needed. The
+     * pattern is processed right-to-left starting from the given state, and the
+     * state is updated so a longer pattern can be processed in pieces.
+     */
+    template <class alphabet_t, class output_t>
+    void _query(const char* pattern, const size_t m, const alphabet_t& alphabet, size_t* ms_pointers,
+                size_t* doc_nums, const DocumentArray* doc_arr, query_state& state, RunCache& cache) {
+        const ulint n = this->bwt.size();
+        ulint pos = state.pos;
+        ulint sample = state.sample;
+        size_t curr_doc_id = state.doc;
+
+        for (size_t i = m; i-- > 0;) {
+            const uint8_t c = static_cast<uint8_t>(pattern[i]);
+            const ulint num_c = alphabet.count(c);
+
+            if (num_c == 0) {
+                sample = 0;
+                if (output_t::report_docs) {curr_doc_id = doc_arr->start_doc(this->bwt.run_of_position(sample));}
+            }
+            else if (pos < n && this->bwt[pos] == c) {sample--;}
+            else {
+                // Get threshold
+                ri::ulint rnk = this->bwt.rank(pos, c);
+                size_t thr = n + 1;
+                ulint next_pos = pos;
 
-                    next_pos = j;
+                if (rnk < num_c) {
+                    // first position of the next run of c's, its sample is only needed if it is taken
+                    run_cache_entry& next_run = lookup_run(cache, c, rnk, doc_arr);
+                    thr = next_run.thr;
+                    if (pos >= thr) {
+                        sample = entry_sample_start(next_run);
+                        if (output_t::report_docs) {curr_doc_id = next_run.doc_start;}
+                        next_pos = next_run.pos;
+                    }
                 }
 
                 if (pos < thr) {
                     rnk--;
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
-
-                    sample = this->samples_last[run_of_j];
-                    next_pos = j;
+                    run_cache_entry& prev_run = lookup_run(cache, c, rnk, doc_arr);
+                    sample = entry_sample_last(prev_run);
+                    if (output_t::report_docs) {curr_doc_id = prev_run.doc_end;}
+                    next_pos = prev_run.pos;
                 }
 
                 pos = next_pos;
             }
 
-            ms_pointers[m - i - 1] = sample;
-            
+            ms_pointers[i] = sample;
+            if (output_t::report_docs) {doc_nums[i] = curr_doc_id;}
+
             // Perform one backward step
-            pos = LF(pos, c);
+            pos = alphabet.get_F(c) + this->bwt.rank(pos, c);
         }
+        state.pos = pos;
+        state.sample = sample;
+        state.doc = curr_doc_id;
     }
 
-    template<typename string_t>
-    void _query(const string_t &pattern, const size_t m, std::vector<size_t>& ms_pointers,
-                std::vector<size_t>& doc_nums, DocumentArray& doc_arr) {
-        // Actual MS Computation
-        ms_pointers.resize(m);
-        doc_nums.resize(m);
+}; /* End of ms_pointers */
 
-        auto pos = this->bwt_size() - 1;
-        auto sample = this->get_last_run_sample();
-        size_t curr_doc_id = doc_arr.end_runs_doc[this->bwt.number_of_runs()-1];
+/*
+ * Queries a batch of reads in the order of their reversed sequences, which is
+ * a depth-first walk of the trie of their suffixes. The state and output after
+ * each step of the current path are kept by depth, so the steps of the suffix
+ * shared with the previous read are reused instead of being computed again.
+ * This works for both indexes since the state only depends on the suffix.
+ */
 
-        for (size_t i = 0; i < m; ++i) 
-        {
-            auto c = pattern[m - i - 1];
-            if (this->bwt.number_of_letter(c) == 0){
-                sample = 0;
-                ri::ulint run_of_j = this->bwt.run_of_position(sample);
-                curr_doc_id = doc_arr.start_runs_doc[run_of_j];
-            }
-            else if (pos < this->bwt.size() && this->bwt[pos] == c){sample--;}
-            else {
-                // Get threshold
-                ri::ulint rnk = this->bwt.rank(pos, c);
-                size_t thr = this->bwt.size() + 1;
-                ulint next_pos = pos;
+template <class alphabet_t, class output_t, class index_t>
+size_t query_shared_suffixes(index_t& index, const std::vector<std::string>& reads, std::vector<std::vector<size_t>>& values,
+                             std::vector<std::vector<size_t>>& doc_nums, const DocumentArray* doc_arr) {
+    /* Computes the values of each read in the batch, and returns the number of steps that were reused */
+    std::vector<size_t> order(reads.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::lexicographical_compare(reads[a].rbegin(), reads[a].rend(), reads[b].rbegin(), reads[b].rend());
+    });
+
+    // path[d] holds the state and output after the last d characters of the current read
+    std::vector<typename index_t::query_state> path_states(1, index.initial_state(doc_arr));
+    std::vector<size_t> path_values(1, 0), path_docs(1, 0);
+    RunCache& cache = index.run_cache(doc_arr);
+
+    values.resize(reads.size());
+    if (output_t::report_docs) {doc_nums.resize(reads.size());}
+
+    size_t reused_steps = 0;
+    const std::string* prev_read = nullptr;
+    for (size_t read_id: order) {
+        const std::string& read = reads[read_id];
+        const size_t m = read.length();
+
+        // length of the suffix shared with the previous read
+        size_t shared = 0;
+        if (prev_read != nullptr) {
+            const size_t prev_m = prev_read->length();
+            while (shared < m && shared < prev_m && read[m-1-shared] == (*prev_read)[prev_m-1-shared])
+                shared++;
+        }
+        if (path_states.size() < m + 1) {
+            path_states.resize(m + 1);
+            path_values.resize(m + 1);
+            path_docs.resize(m + 1);
+        }
 
-                if (rnk < this->bwt.number_of_letter(c)) {
-                    // j is the first position of the next run of c's
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
+        for (size_t d = shared + 1; d <= m; d++) {
+            path_states[d] = path_states[d-1];
+            index.template query_piece<alphabet_t, output_t>(read.data() + m - d, 1, &path_values[d],
+                                                             &path_docs[d], doc_arr, path_states[d], cache);
+        }
+        reused_steps += shared;
+
+        values[read_id].resize(m);
+        for (size_t i = 0; i < m; i++)
+            values[read_id][i] = path_values[m - i];
+        if (output_t::report_docs) {
+            doc_nums[read_id].resize(m);
+            for (size_t i = 0; i < m; i++)
+                doc_nums[read_id][i] = path_docs[m - i];
+        }
+        prev_read = &read;
+    }
+    return reused_steps;
+}
 
-                    thr = thresholds[run_of_j]; // If it is the first run thr = 0
-                    sample = samples_start[run_of_j];
-                    curr_doc_id = doc_arr.start_runs_doc[run_of_j];
 
-                    next_pos = j;
-                }
+/*
+ * The RLBWT and thresholds can be stored using different bitvectors and the classes
+ * in thresholds_ds.hpp, so this section maps the rlbwt_type and thresholds_type
+ * chosen by the user to those classes. A new backend only needs an entry in the
+ * enum, a case in the dispatch functions, and alternatives in the index variant.
+ */
 
-                if (pos < thr) {
-                    rnk--;
-                    ri::ulint j = this->bwt.select(rnk, c);
-                    ri::ulint run_of_j = this->bwt.run_of_position(j);
+template <class rle_string_t, class thresholds_t>
+struct index_tag {
+    /* Carries the classes of the index into a generic lambda */
+    using rle_string = rle_string_t;
+    using thresholds = thresholds_t;
+};
 
-                    sample = this->samples_last[run_of_j];
-                    curr_doc_id = doc_arr.end_runs_doc[run_of_j];
-                    next_pos = j;
-                }
+template <class rle_string_t, typename func_t>
+auto dispatch_thresholds(thresholds_type type, func_t func) {
+    /* Calls the function with the tag of the thresholds class for this type */
+    switch (type) {
+        case THR_BV: return func(index_tag<rle_string_t, thr_bv<rle_string_t>>());
+        case THR_PLAIN: return func(index_tag<rle_string_t, thr_plain<rle_string_t>>());
+        case THR_COMPRESSED: return func(index_tag<rle_string_t, thr_compressed<rle_string_t>>());
+        default: FATAL_ERROR("Unrecognized type of thresholds data-structure.");
+    }
+}
 
-                pos = next_pos;
-            }
+template <typename func_t>
+auto dispatch_index(rlbwt_type bwt_type, thresholds_type thr_type, func_t func) {
+    /* Calls the function with the tag of the RLBWT and thresholds classes for these types */
+    switch (bwt_type) {
+        case RLBWT_SD: return dispatch_thresholds<ms_rle_string_sd>(thr_type, func);
+        case RLBWT_HYB: return dispatch_thresholds<ms_rle_string_hyb>(thr_type, func);
+        default: FATAL_ERROR("Unrecognized type of RLBWT bitvector.");
+    }
+}
 
-            ms_pointers[m-i-1] = sample;
-            doc_nums[m-i-1] = curr_doc_id;
-            
-            // Perform one backward step
-            pos = LF(pos, c);
+template <class tag_t>
+using pml_index_t = pml_pointers<ri::sparse_sd_vector, typename tag_t::rle_string, typename tag_t::thresholds>;
+
+template <class tag_t>
+using ms_index_t = ms_pointers<ri::sparse_sd_vector, typename tag_t::rle_string, typename tag_t::thresholds>;
+
+template <template <class> class index_t>
+using index_variant_t = std::variant<index_t<index_tag<ms_rle_string_sd, thr_bv<ms_rle_string_sd>>>,
+                                     index_t<index_tag<ms_rle_string_sd, thr_plain<ms_rle_string_sd>>>,
+                                     index_t<index_tag<ms_rle_string_sd, thr_compressed<ms_rle_string_sd>>>,
+                                     index_t<index_tag<ms_rle_string_hyb, thr_bv<ms_rle_string_hyb>>>,
+                                     index_t<index_tag<ms_rle_string_hyb, thr_plain<ms_rle_string_hyb>>>,
+                                     index_t<index_tag<ms_rle_string_hyb, thr_compressed<ms_rle_string_hyb>>>>;
+
+std::string get_thresholds_extension(thresholds_type type) {
+    /* Returns the file extension used by this type of thresholds */
+    return dispatch_thresholds<ms_rle_string_sd>(type, [](auto tag) {
+        return decltype(tag)::thresholds::get_file_extension();
+    });
+}
+
+std::string get_thresholds_name(thresholds_type type) {
+    /* Returns the name of this type of thresholds, as used on the command-line */
+    switch (type) {
+        case THR_BV: return "bv";
+        case THR_PLAIN: return "plain";
+        case THR_COMPRESSED: return "compressed";
+        default: return "none";
+    }
+}
+
+std::string get_rlbwt_extension(rlbwt_type type) {
+    /* Returns the marker added to the file name for this type of RLBWT */
+    return dispatch_index(type, THR_BV, [](auto tag) {return decltype(tag)::rle_string::get_file_extension();});
+}
+
+std::string get_rlbwt_name(rlbwt_type type) {
+    /* Returns the name of this type of RLBWT, as used on the command-line */
+    switch (type) {
+        case RLBWT_SD: return "sd";
+        case RLBWT_HYB: return "hyb";
+        default: return "none";
+    }
+}
+
+bool find_index_type(std::string index_prefix, output_type index_type, rlbwt_type& bwt_type, thresholds_type& thr_type) {
+    /* 
+     * Looks for the index files, and fills in the types that were not given. If there
+     * are several, it prefers the hybrid bitvectors and the thresholds with the fastest 
+     * lookup. Returns false if none of the index files are present.
+     */
+    std::string index_ext = (index_type == MS) ? ".ms" : ".spumoni";
+    std::vector<rlbwt_type> bwt_options = {RLBWT_HYB, RLBWT_SD};
+    std::vector<thresholds_type> thr_options = {THR_PLAIN, THR_BV, THR_COMPRESSED};
+    if (bwt_type != RLBWT_NONE) bwt_options = {bwt_type};
+    if (thr_type != THR_NONE) thr_options = {thr_type};
+
+    for (auto curr_bwt: bwt_options) {
+        for (auto curr_thr: thr_options) {
+            if (is_file(index_prefix + get_rlbwt_extension(curr_bwt) + get_thresholds_extension(curr_thr) + index_ext)) {
+                bwt_type = curr_bwt; thr_type = curr_thr;
+                return true;
+            }
         }
     }
+    return false;
+}
 
-}; /* End of ms_pointers */
+template <class index_t>
+IndexBenchmark benchmark_index(index_t& index, rlbwt_type bwt_type, thresholds_type thr_type, size_t index_bytes) {
+    /* Measures the size of the thresholds, and the average time for thresholds lookups and LF steps */
+    IndexBenchmark bench;
+    bench.bwt_type = bwt_type;
+    bench.thr_type = thr_type;
+    bench.index_bytes = index_bytes;
 
+    sdsl::nullstream ns;
+    bench.thresholds_bytes = index.thresholds.serialize(ns);
+
+    // generate the runs and positions beforehand, so only the lookups are timed
+    size_t length = 0, num_runs = 0;
+    std::tie(length, num_runs) = index.get_bwt_stats();
+    std::mt19937_64 rng (INDEX_BENCH_SEED);
+    std::uniform_int_distribution<size_t> run_dist (0, num_runs - 1);
+    std::uniform_int_distribution<size_t> pos_dist (0, length - 1);
+
+    std::vector<size_t> runs (INDEX_BENCH_LOOKUPS), positions (INDEX_BENCH_LOOKUPS);
+    for (auto& run: runs) {run = run_dist(rng);}
+    for (auto& pos: positions) {pos = pos_dist(rng);}
+
+    volatile size_t checksum = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (auto run: runs) {checksum += index.thresholds[run];}
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start_time);
+    bench.thr_lookup_ns = elapsed.count() / runs.size();
+
+    // an LF step is an access and a rank on the RLBWT, which is the cost of each query step 
+    start_time = std::chrono::high_resolution_clock::now();
+    for (auto pos: positions) {checksum += index.LF(pos);}
+    elapsed = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start_time);
+    bench.lf_step_ns = elapsed.count() / positions.size();
+    return bench;
+}
+
+template <class index_t>
+void benchmark_samples(index_t& index, size_t full_samples_bytes, IndexBenchmark& bench) {
+    /* Measures the size of the SA samples, and the average time to get the sample at the end of a random run */
+    bench.full_samples_bytes = full_samples_bytes;
+    bench.samples_bytes = index.samples_size_in_bytes();
+
+    size_t num_runs = index.get_bwt_stats().second;
+    std::mt19937_64 rng (INDEX_BENCH_SEED);
+    std::uniform_int_distribution<size_t> run_dist (0, num_runs - 1);
+    std::vector<size_t> runs (INDEX_BENCH_LOOKUPS);
+    for (auto& run: runs) {run = run_dist(rng);}
+
+    volatile size_t checksum = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for (auto run: runs) {checksum += index.get_sample_last(run);}
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start_time);
+    bench.sample_lookup_ns = elapsed.count() / runs.size();
+}
 
 /*
  * The next section contains another set of classes that are instantiated 
  * when loading the MS or PML index for computation, and they are called
  * ms_t and pml_t. One of its attributes are the ms_pointers and 
- * pml_pointers as previously defined.
+ * pml_pointers as previously defined, and the type of thresholds in
+ * them is chosen when the index is loaded.
  */
 
 class pml_t {
@@ -682,14 +1200,25 @@ public:
     DocArray doc_arr; 
 
     // Constructor
-    pml_t(std::string filename, bool use_doc, bool verbose = false){
-        if (verbose){STATUS_LOG("pml_construct", "loading the PML index");}
+    pml_t(std::string filename, bool use_doc, bool verbose = false, 
+          rlbwt_type bwt_type = RLBWT_NONE, thresholds_type thr_type = THR_NONE) {
+        find_index_type(filename, PML, bwt_type, thr_type);
+        this->bwt_type = bwt_type;
+        this->thr_type = thr_type;
+
+        if (verbose){STATUS_LOG("pml_construct", "loading the PML index (%s rlbwt, %s thresholds)", 
+                                get_rlbwt_name(bwt_type).data(), get_thresholds_name(thr_type).data());}
         auto start_time = std::chrono::system_clock::now();
-        std::string filename_ms = filename + ms.get_file_extension();
 
-        std::ifstream fs_ms(filename_ms);
-        ms.load(fs_ms);
-        fs_ms.close();
+        dispatch_index(bwt_type, thr_type, [&](auto tag) {
+            using index_t = pml_index_t<decltype(tag)>;
+            std::ifstream fs_ms(filename + index_t::get_file_extension());
+
+            // loaded in-place, since the thresholds keep a pointer to the BWT
+            ms.template emplace<index_t>().load(fs_ms);
+            fs_ms.close();
+        });
+        set_query_kernels<general_alphabet>();
 
         auto end_time = std::chrono::system_clock::now();
         if (verbose) {DONE_LOG((end_time - start_time));}
@@ -697,9 +1226,10 @@ public:
         if (use_doc) {
             if (verbose) {STATUS_LOG("pml_construct", "loading the document array");}
             start_time = std::chrono::system_clock::now();
-            std::ifstream doc_file(filename + ".doc");
+            std::string doc_extension = DocumentArray::get_file_extension(filename);
+            std::ifstream doc_file(filename + doc_extension);
 
-            doc_arr.load(doc_file);
+            doc_arr.load(doc_file, doc_extension == ".rldoc");
             doc_file.close();
             if (verbose) {DONE_LOG((std::chrono::system_clock::now() - start_time));}
         }
@@ -708,26 +1238,118 @@ public:
     //Destructor
     ~pml_t() {}
 
+    rlbwt_type get_rlbwt_type() const {return bwt_type;}
+    thresholds_type get_thresholds_type() const {return thr_type;}
+
+    void select_query_kernels(alphabet_type alphabet) {
+        /* Chooses the specialized kernels once, so there are no mode checks while querying */
+        switch (alphabet) {
+            case DNA_ALPHABET: set_query_kernels<dna_alphabet>(); break;
+            case MINIMIZER_ALPHABET:
+            case GENERAL_ALPHABET: set_query_kernels<general_alphabet>(); break;
+            default: FATAL_ERROR("Unrecognized alphabet type for the query kernel.");
+        }
+    }
+
     /*
      * Overloaded functions - based on whether you want to report the
      * document numbers or not.
      */
     void matching_statistics(const char* read, size_t read_length, std::vector<size_t>& lengths) {
-        ms.query(read, read_length, lengths);
+        std::vector<size_t> doc_nums;
+        stats_kernel(ms, read, read_length, lengths, doc_nums, nullptr);
     }
 
     void matching_statistics(const char* read, size_t read_length, std::vector<size_t>& lengths, 
                              std::vector<size_t>& doc_nums) {
-        ms.query(read, read_length, lengths, doc_nums, doc_arr);
+        doc_kernel(ms, read, read_length, lengths, doc_nums, &doc_arr);
+    }
+
+    /*
+     * Same as above, but the read is digested into minimizers while it
+     * is being queried instead of beforehand.
+     */
+    void streaming_statistics(MinimizerDigester& digester, const char* read, size_t read_length, 
+                              std::vector<size_t>& lengths) {
+        std::vector<size_t> doc_nums;
+        streaming_stats_kernel(ms, digester, read, read_length, lengths, doc_nums, nullptr);
+    }
+
+    void streaming_statistics(MinimizerDigester& digester, const char* read, size_t read_length, 
+                              std::vector<size_t>& lengths, std::vector<size_t>& doc_nums) {
+        streaming_doc_kernel(ms, digester, read, read_length, lengths, doc_nums, &doc_arr);
+    }
+
+    size_t batch_statistics(const std::vector<std::string>& reads, std::vector<std::vector<size_t>>& lengths,
+                            std::vector<std::vector<size_t>>& doc_nums, bool use_doc) {
+        /* Computes the PMLs of a batch of reads, and returns the number of steps shared between them */
+        if (use_doc) {return batch_doc_kernel(ms, reads, lengths, doc_nums, &doc_arr);}
+        return batch_stats_kernel(ms, reads, lengths, doc_nums, nullptr);
+    }
+
+    void list_documents(const std::string& query, size_t start, size_t length, DocumentLister& lister) {
+        /* Lists every document that contains the given part of the query */
+        std::visit([&](auto& index) {index.list_documents(query.data() + start, length, doc_arr, lister);}, ms);
+    }
+
+    void find_doc_starts(DocumentArray& arr) {
+        /* Finds the BWT rows of the document starts in a document array that is being built */
+        std::visit([&](auto& index) {arr.find_doc_starts([&](size_t i) {return index.LF(i);});}, ms);
     }
     
     std::pair<ulint, ulint> get_bwt_stats() {
-        return ms.get_bwt_stats();
+        return std::visit([](auto& index) {return index.get_bwt_stats();}, ms);
     }
 
 protected:
-  pml_pointers<> ms;
+  using index_variant = index_variant_t<pml_index_t>;
+  using kernel_t = void (*)(index_variant&, const char*, const size_t, std::vector<size_t>&, 
+                            std::vector<size_t>&, const DocumentArray*);
+  using streaming_kernel_t = void (*)(index_variant&, MinimizerDigester&, const char*, const size_t, 
+                                      std::vector<size_t>&, std::vector<size_t>&, const DocumentArray*);
+  using batch_kernel_t = size_t (*)(index_variant&, const std::vector<std::string>&, std::vector<std::vector<size_t>>&,
+                                    std::vector<std::vector<size_t>>&, const DocumentArray*);
+  index_variant ms;
+  rlbwt_type bwt_type = RLBWT_NONE;
+  thresholds_type thr_type = THR_NONE;
   size_t n = 0;
+  kernel_t stats_kernel = nullptr;
+  kernel_t doc_kernel = nullptr;
+  streaming_kernel_t streaming_stats_kernel = nullptr;
+  streaming_kernel_t streaming_doc_kernel = nullptr;
+  batch_kernel_t batch_stats_kernel = nullptr;
+  batch_kernel_t batch_doc_kernel = nullptr;
+
+  template <class index_t, class alphabet_t, class output_t>
+  static void run_query(index_variant& ms, const char* read, const size_t read_length, std::vector<size_t>& lengths, 
+                        std::vector<size_t>& doc_nums, const DocumentArray* doc_arr) {
+      std::get<index_t>(ms).template query<alphabet_t, output_t>(read, read_length, lengths, doc_nums, doc_arr);
+  }
+
+  template <class index_t, class alphabet_t, class output_t>
+  static void run_streaming_query(index_variant& ms, MinimizerDigester& digester, const char* read, const size_t read_length, 
+                                  std::vector<size_t>& lengths, std::vector<size_t>& doc_nums, const DocumentArray* doc_arr) {
+      std::get<index_t>(ms).template streaming_query<alphabet_t, output_t>(digester, read, read_length, lengths, doc_nums, doc_arr);
+  }
+
+  template <class index_t, class alphabet_t, class output_t>
+  static size_t run_batch_query(index_variant& ms, const std::vector<std::string>& reads, std::vector<std::vector<size_t>>& lengths,
+                                std::vector<std::vector<size_t>>& doc_nums, const DocumentArray* doc_arr) {
+      return query_shared_suffixes<alphabet_t, output_t>(std::get<index_t>(ms), reads, lengths, doc_nums, doc_arr);
+  }
+
+  template <class alphabet_t>
+  void set_query_kernels() {
+      std::visit([&](auto& index) {
+          using index_t = std::decay_t<decltype(index)>;
+          stats_kernel = &run_query<index_t, alphabet_t, stats_output>;
+          doc_kernel = &run_query<index_t, alphabet_t, doc_output>;
+          streaming_stats_kernel = &run_streaming_query<index_t, alphabet_t, stats_output>;
+          streaming_doc_kernel = &run_streaming_query<index_t, alphabet_t, doc_output>;
+          batch_stats_kernel = &run_batch_query<index_t, alphabet_t, stats_output>;
+          batch_doc_kernel = &run_batch_query<index_t, alphabet_t, doc_output>;
+      }, ms);
+  }
 };
 
 class ms_t {
@@ -737,14 +1359,25 @@ public:
     using DocArray = DocumentArray;
     DocArray doc_arr;
 
-    ms_t(std::string filename, bool use_doc, bool verbose=false) {
-        if (verbose) {STATUS_LOG("ms_construct", "loading the MS index");}
+    ms_t(std::string filename, bool use_doc, bool verbose=false, 
+         rlbwt_type bwt_type = RLBWT_NONE, thresholds_type thr_type = THR_NONE) {
+        find_index_type(filename, MS, bwt_type, thr_type);
+        this->bwt_type = bwt_type;
+        this->thr_type = thr_type;
+
+        if (verbose) {STATUS_LOG("ms_construct", "loading the MS index (%s rlbwt, %s thresholds)", 
+                                 get_rlbwt_name(bwt_type).data(), get_thresholds_name(thr_type).data());}
         auto start_time = std::chrono::system_clock::now();    
-        std::string filename_ms = filename + ms.get_file_extension();
 
-        ifstream fs_ms(filename_ms);
-        ms.load(fs_ms);
-        fs_ms.close();
+        dispatch_index(bwt_type, thr_type, [&](auto tag) {
+            using index_t = ms_index_t<decltype(tag)>;
+            ifstream fs_ms(filename + index_t::get_file_extension());
+
+            // loaded in-place, since the thresholds keep a pointer to the BWT
+            ms.template emplace<index_t>().load(fs_ms);
+            fs_ms.close();
+        });
+        set_query_kernels<general_alphabet>();
 
         auto end_time = std::chrono::system_clock::now();
         if (verbose) {DONE_LOG((end_time - start_time));}
@@ -762,9 +1395,10 @@ public:
         if (use_doc) {
             if (verbose) {STATUS_LOG("ms_construct", "loading the document array");}
             start_time = std::chrono::system_clock::now();
-            std::ifstream doc_file(filename + ".doc");
+            std::string doc_extension = DocumentArray::get_file_extension(filename);
+            std::ifstream doc_file(filename + doc_extension);
 
-            doc_arr.load(doc_file);
+            doc_arr.load(doc_file, doc_extension == ".rldoc");
             doc_file.close();
             if (verbose) {DONE_LOG((std::chrono::system_clock::now() - start_time));}
         }
@@ -773,6 +1407,19 @@ public:
     // Destructor
     ~ms_t() {}
 
+    rlbwt_type get_rlbwt_type() const {return bwt_type;}
+    thresholds_type get_thresholds_type() const {return thr_type;}
+
+    void select_query_kernels(alphabet_type alphabet) {
+        /* Chooses the specialized kernels once, so there are no mode checks while querying */
+        switch (alphabet) {
+            case DNA_ALPHABET: set_query_kernels<dna_alphabet>(); break;
+            case MINIMIZER_ALPHABET:
+            case GENERAL_ALPHABET: set_query_kernels<general_alphabet>(); break;
+            default: FATAL_ERROR("Unrecognized alphabet type for the query kernel.");
+        }
+    }
+
     /*
      * Overloaded functions - used to compute the MS depending on 
      * whether you want to extract document numbers or not.
@@ -780,44 +1427,111 @@ public:
     void matching_statistics(const char* read, size_t read_length, std::vector<size_t>& lengths, 
                             std::vector<size_t>& pointers) {  
         // Takes a read, and generates the MS with respect to this ms_t object
-        ms.query(read, read_length, pointers);
-        lengths.resize(read_length);
-        size_t l = 0;
-
-        for (size_t i = 0; i < pointers.size(); ++i) {
-            size_t pos = pointers[i];
-            while ((i + l) < read_length && (pos + l) < n && (i < 1 || pos != (pointers[i-1] + 1) ) && read[i + l] == ra.charAt(pos + l))
-                ++l;
-            lengths[i] = l;
-            l = (l == 0 ? 0 : (l - 1));
-        }
-        assert(lengths.size() == pointers.size());
+        std::vector<size_t> doc_nums;
+        stats_kernel(ms, read, read_length, pointers, doc_nums, nullptr);
+        extend_lengths(read, read_length, pointers, lengths);
     }
 
     void matching_statistics(const char* read, size_t read_length, std::vector<size_t>& lengths, 
                             std::vector<size_t>& pointers, std::vector<size_t>& doc_nums) {  
         // Takes a read, and generates the MS with respect to this ms_t object
-        ms.query(read, read_length, pointers, doc_nums, doc_arr);
-        lengths.resize(read_length);
-        size_t l = 0;
-        for (size_t i = 0; i < pointers.size(); ++i) {
-            size_t pos = pointers[i];
-            while ((i + l) < read_length && (pos + l) < n && (i < 1 || pos != (pointers[i-1] + 1) ) && read[i + l] == ra.charAt(pos + l))
-                ++l;
-            lengths[i] = l;
-            l = (l == 0 ? 0 : (l - 1));
-        }
-        assert(lengths.size() == pointers.size());
+        doc_kernel(ms, read, read_length, pointers, doc_nums, &doc_arr);
+        extend_lengths(read, read_length, pointers, lengths);
+    }
+
+    size_t batch_statistics(const std::vector<std::string>& reads, std::vector<std::vector<size_t>>& lengths,
+                            std::vector<std::vector<size_t>>& pointers, std::vector<std::vector<size_t>>& doc_nums, 
+                            bool use_doc) {
+        /* Computes the MSs of a batch of reads, and returns the number of steps shared between them */
+        size_t reused_steps = (use_doc) ? batch_doc_kernel(ms, reads, pointers, doc_nums, &doc_arr)
+                                        : batch_stats_kernel(ms, reads, pointers, doc_nums, nullptr);
+        lengths.resize(reads.size());
+        for (size_t i = 0; i < reads.size(); i++)
+            extend_lengths(reads[i].data(), reads[i].length(), pointers[i], lengths[i]);
+        return reused_steps;
+    }
+
+    void list_documents(const std::string& query, size_t start, size_t length, DocumentLister& lister) {
+        /* Lists every document that contains the given part of the query */
+        std::visit([&](auto& index) {index.list_documents(query.data() + start, length, doc_arr, lister);}, ms);
+    }
+
+    void find_doc_starts(DocumentArray& arr) {
+        /* Finds the BWT rows of the document starts in a document array that is being built */
+        std::visit([&](auto& index) {arr.find_doc_starts([&](size_t i) {return index.LF(i);});}, ms);
+    }
+
+    size_t get_ssa_rate() {
+        /* Returns the rate the SA samples were subsampled at (0 if all are kept) */
+        return std::visit([](auto& index) {return index.ssa_rate;}, ms);
+    }
+
+    size_t build_locate_support() {
+        /* Builds the Phi support used to locate every occurrence of a match, and returns its size in bytes */
+        return std::visit([](auto& index) {index.build_phi(); return index.phi_size_in_bytes();}, ms);
+    }
+
+    void locate_matches(const std::string& query, MatchLocator& locator) {
+        /* Locates the occurrences of the parts of the query added to the locator */
+        std::visit([&](auto& index) {locator.locate(index, query.data());}, ms);
     }
 
     std::pair<ulint, ulint> get_bwt_stats() {
-        return ms.get_bwt_stats();
+        return std::visit([](auto& index) {return index.get_bwt_stats();}, ms);
     }
   
 protected:
-  ms_pointers<> ms;
+  using index_variant = index_variant_t<ms_index_t>;
+  using kernel_t = void (*)(index_variant&, const char*, const size_t, std::vector<size_t>&, 
+                            std::vector<size_t>&, const DocumentArray*);
+  using batch_kernel_t = size_t (*)(index_variant&, const std::vector<std::string>&, std::vector<std::vector<size_t>>&,
+                                    std::vector<std::vector<size_t>>&, const DocumentArray*);
+  index_variant ms;
+  rlbwt_type bwt_type = RLBWT_NONE;
+  thresholds_type thr_type = THR_NONE;
   SelfShapedSlp<uint32_t, DagcSd, DagcSd, SelSd> ra;
   size_t n = 0;
+  kernel_t stats_kernel = nullptr;
+  kernel_t doc_kernel = nullptr;
+  batch_kernel_t batch_stats_kernel = nullptr;
+  batch_kernel_t batch_doc_kernel = nullptr;
+
+  void extend_lengths(const char* read, size_t read_length, const std::vector<size_t>& pointers, std::vector<size_t>& lengths) {
+      /* Computes the MS lengths by comparing the read with the text at each pointer, reusing the previous length */
+      lengths.resize(read_length);
+      size_t l = 0;
+      for (size_t i = 0; i < pointers.size(); ++i) {
+          size_t pos = pointers[i];
+          while ((i + l) < read_length && (pos + l) < n && (i < 1 || pos != (pointers[i-1] + 1) ) && read[i + l] == ra.charAt(pos + l))
+              ++l;
+          lengths[i] = l;
+          l = (l == 0 ? 0 : (l - 1));
+      }
+      assert(lengths.size() == pointers.size());
+  }
+
+  template <class index_t, class alphabet_t, class output_t>
+  static void run_query(index_variant& ms, const char* read, const size_t read_length, std::vector<size_t>& pointers, 
+                        std::vector<size_t>& doc_nums, const DocumentArray* doc_arr) {
+      std::get<index_t>(ms).template query<alphabet_t, output_t>(read, read_length, pointers, doc_nums, doc_arr);
+  }
+
+  template <class index_t, class alphabet_t, class output_t>
+  static size_t run_batch_query(index_variant& ms, const std::vector<std::string>& reads, std::vector<std::vector<size_t>>& pointers,
+                                std::vector<std::vector<size_t>>& doc_nums, const DocumentArray* doc_arr) {
+      return query_shared_suffixes<alphabet_t, output_t>(std::get<index_t>(ms), reads, pointers, doc_nums, doc_arr);
+  }
+
+  template <class alphabet_t>
+  void set_query_kernels() {
+      std::visit([&](auto& index) {
+          using index_t = std::decay_t<decltype(index)>;
+          stats_kernel = &run_query<index_t, alphabet_t, stats_output>;
+          doc_kernel = &run_query<index_t, alphabet_t, doc_output>;
+          batch_stats_kernel = &run_batch_query<index_t, alphabet_t, stats_output>;
+          batch_doc_kernel = &run_batch_query<index_t, alphabet_t, doc_output>;
+      }, ms);
+  }
 };
 
 /*
@@ -825,291 +1539,650 @@ protected:
  * based on whether it is requested to use MS/PMLs.
  */
 
-size_t classify_reads_pml(pml_t *pml, std::string ref_filename, std::string pattern_filename, bool use_doc, 
-                          bool min_digest, bool write_report, size_t num_threads,
-                          size_t k, size_t w, bool use_promotions, bool use_dna_letters, size_t bin_width) {
+alphabet_type get_query_alphabet(bool is_general_text, bool use_promotions) {
+    /* Determines the alphabet of the reads after digestion, DNA minimizers still use DNA letters */
+    if (is_general_text) return GENERAL_ALPHABET;
+    else if (use_promotions) return MINIMIZER_ALPHABET;
+    return DNA_ALPHABET;
+}
 
-    // Added for debugging ....
-    //std::ofstream ks_stat_file (pattern_filename + ".ks_stats");
+const char* get_alphabet_name(alphabet_type alphabet) {
+    /* Returns a description of the alphabet used for logging */
+    switch (alphabet) {
+        case DNA_ALPHABET: return "DNA";
+        case MINIMIZER_ALPHABET: return "promoted minimizer";
+        default: return "general text";
+    }
+}
 
-    // declare output file and iterator
-    std::ofstream lengths_file (pattern_filename + ".pseudo_lengths");
-    std::ostream_iterator<size_t> lengths_iter (lengths_file, " ");
+template <typename index_t>
+std::vector<index_t*> load_index_replicas(SpumoniRunOptions* run_opts, const NumaTopology& topology, const char* func) {
+    /* Loads the index according to the requested NUMA placement, and returns one pointer per replica */
+    std::vector<index_t*> replicas;
+    bool use_replicas = (run_opts->numa_placement == NUMA_REPLICATE && topology.num_nodes() > 1);
 
-    std::ofstream doc_file, report_file;
-    std::ostream_iterator<size_t> doc_iter (doc_file, " ");
+    // only keep copies on nodes that will actually have threads running on them
+    size_t num_replicas = (use_replicas) ? std::min(topology.num_nodes(), run_opts->threads) : 1;
 
-    if (use_doc) {doc_file.open(pattern_filename + ".doc_numbers");}
-    if (write_report) {report_file.open(pattern_filename + ".report", std::ofstream::out);}
-    //KSTest sig_test (ref_filename.data(), PML, write_report, report_file, bin_width);
+    if (use_replicas) {
+        replicas.resize(num_replicas, nullptr);
 
-    // load empirical null pml database, and prepare output report if requested
-    EmpNullDatabase null_db;
-    std::string null_db_path = ref_filename + ".pmlnulldb";
+        STATUS_LOG(func, "loading a copy of the index on each of %ld numa nodes", num_replicas);
+        auto start_time = std::chrono::system_clock::now();
 
-    std::ifstream in(null_db_path);
-    null_db.load(in);
-    in.close();
+        // each copy is loaded by a thread on that node, so pages are bound to its local memory
+        std::vector<std::thread> loaders;
+        for (size_t node = 0; node < num_replicas; node++) {
+            loaders.emplace_back([&, node]() {
+                topology.pin_thread_to_node(node);
+                topology.bind_memory_to_node(node);
+                std::unique_ptr<HugePageScope> huge_pages ((run_opts->use_huge_pages) ? new HugePageScope(topology.node_ids[node]) : nullptr);
+                replicas[node] = new index_t(run_opts->ref_file, run_opts->use_doc, false, run_opts->bwt_type, run_opts->thr_type);
+                NumaTopology::reset_memory_policy();
+            });
+        }
+        for (auto& loader: loaders) loader.join();
+        DONE_LOG((std::chrono::system_clock::now() - start_time));
+    } else if (run_opts->numa_placement == NUMA_INTERLEAVE && topology.num_nodes() > 1) {
+        // spread the pages of a single copy evenly across all the nodes
+        if (!topology.interleave_memory())
+            FORCE_LOG(func, "unable to set interleaved memory policy, index will use default placement");
+        std::unique_ptr<HugePageScope> huge_pages ((run_opts->use_huge_pages) ? new HugePageScope() : nullptr);
+        replicas.push_back(new index_t(run_opts->ref_file, run_opts->use_doc, true, run_opts->bwt_type, run_opts->thr_type));
+        NumaTopology::reset_memory_policy();
+    } else {
+        if (run_opts->numa_placement != NUMA_OFF)
+            FORCE_LOG(func, "only one numa node was found, so the index will use default placement");
+        std::unique_ptr<HugePageScope> huge_pages ((run_opts->use_huge_pages) ? new HugePageScope() : nullptr);
+        replicas.push_back(new index_t(run_opts->ref_file, run_opts->use_doc, true, run_opts->bwt_type, run_opts->thr_type));
+    }
 
-    size_t max_value_thr = std::max(null_db.percentile_value, 3.0); 
-    if (use_dna_letters)
-        max_value_thr++;
-    else if (!use_dna_letters && !use_promotions)
-        max_value_thr += 4;
+    // the large arrays of each copy were allocated on huge pages while it was loaded
+    if (run_opts->use_huge_pages) {
+        HugePageStats stats = get_hugepage_stats();
+        FORCE_LOG(func, "%.1f MB of the index was placed on reserved 2 MB huge pages", stats.reserved_bytes/(1024.0 * 1024.0));
+        if (stats.advised_bytes > 0) {
+            FORCE_LOG(func, "no reserved huge pages for the other %.1f MB, advised for transparent huge pages (mode: %s)",
+                      stats.advised_bytes/(1024.0 * 1024.0), get_thp_mode().data());
+            FORCE_LOG(func, "%.1f MB of memory is currently backed by transparent huge pages", 
+                      get_anon_hugepage_bytes()/(1024.0 * 1024.0));
+        }
+    }
+    return replicas;
+}
 
-    if (write_report) {    
-        report_file.precision(4);
-        report_file << std::setw(30) << std::left << "read id:"
-                    << std::setw(15) << std::left << "status:" 
-                    << std::setw(19) << std::left << "avg max-value (thr=" 
-                    << std::setw(2) << std::left << max_value_thr
-                    << std::setw(5) << std::left << "):" 
-                    << std::setw(12) << std::left << "above thr:"
-                    << std::setw(12) << std::left << "below thr:" << std::endl;
+inline size_t reverse_strand_pos(size_t i, size_t fwd_size, size_t rc_size) {
+    /* 
+     * Returns the position of the reverse complement that is compared with position i of the
+     * read. Without digestion (or with canonical minimizers) the strands have the same length
+     * and this is exact. Digesting each strand on its own can pick a different number of
+     * minimizers, and then the position is scaled, which is only an approximation: the
+     * minimizers of the two strands are not paired up, so a match can be compared with a
+     * neighbouring position of the other strand.
+     */
+    return (fwd_size == rc_size) ? (fwd_size - 1 - i) : ((fwd_size - 1 - i) * rc_size / fwd_size);
+}
+
+void take_reverse_strand(const std::vector<size_t>& lengths, const std::vector<size_t>& rc_lengths,
+                         std::vector<size_t>& values, const std::vector<size_t>& rc_values) {
+    /* 
+     * Replaces each value with the one from the reverse complement wherever that strand
+     * has the longer match (ties keep the forward strand). The reverse strand is read
+     * backwards, see reverse_strand_pos. The lengths need to be combined last, and the
+     * strand of each value is recorded with mark_reverse_strand.
+     */
+    if (rc_lengths.empty()) return;
+    const size_t fwd_size = lengths.size(), rc_size = rc_lengths.size();
+    for (size_t i = 0; i < fwd_size; i++) {
+        size_t j = reverse_strand_pos(i, fwd_size, rc_size);
+        if (rc_lengths[j] > lengths[i]) {values[i] = rc_values[j];}
     }
+}
 
-    // open query file, and start to classify
-    std::ifstream input_file (pattern_filename.c_str());
-    omp_set_num_threads(num_threads); 
-    size_t num_reads = 0;
-    srand(0);
+void mark_reverse_strand(const std::vector<size_t>& lengths, const std::vector<size_t>& rc_lengths, std::string& strands) {
+    /* 
+     * Writes the strand that take_reverse_strand keeps at each position, '-' where the value
+     * comes from the reverse complement, so its pointers (positions of the reverse complement
+     * in the text) and documents are not mistaken for ones of the read. Call it before the
+     * lengths are combined.
+     */
+    strands.assign(lengths.size(), '+');
+    if (rc_lengths.empty()) return;
+    const size_t fwd_size = lengths.size(), rc_size = rc_lengths.size();
+    for (size_t i = 0; i < fwd_size; i++) {
+        if (rc_lengths[reverse_strand_pos(i, fwd_size, rc_size)] > lengths[i]) {strands[i] = '-';}
+    }
+}
 
-    #pragma omp parallel
-    {
-        BatchLoader reader;
+template <class index_t>
+void append_doc_lists(index_t* index, const std::string& query, const std::vector<size_t>& lengths, size_t min_length,
+                      char strand, DocumentLister& lister, std::string& text) {
+    /* 
+     * Lists the documents of each maximal match at least min_length long, i.e. a match that is
+     * not part of the match at the position to its left. Each match is written on its own line
+     * with its start, length, strand and documents. Positions are on the queried strand, after
+     * digestion if minimizers are used.
+     */
+    char buf[64];
+    for (size_t i = 0; i < lengths.size() && i < query.size(); i++) {
+        if (lengths[i] < min_length || (i > 0 && lengths[i-1] > lengths[i])) continue;
+        size_t length = std::min(lengths[i], query.size() - i);
+        index->list_documents(query, i, length, lister);
+
+        int len = std::snprintf(buf, sizeof(buf), "%zu\t%zu\t%c\t", i, length, strand);
+        text.append(buf, len);
+        lister.append_docs(text);
+        text.push_back('\n');
+    }
+}
 
-        // Iterates over batches of data until none left
-        while (true) {
-            bool valid_batch = true;
-            #pragma omp critical // one reader at a time
-            {
-                valid_batch = reader.loadBatch(input_file, 1000);
-            }
-            if (!valid_batch) break;
+template <class index_t>
+void append_mems(index_t* index, const std::string& query, const std::vector<size_t>& lengths, const std::vector<size_t>& pointers,
+                 const std::vector<size_t>& doc_nums, size_t min_length, char strand, MatchLocator* locator, std::string& text) {
+    /* 
+     * Writes each maximal match at least min_length long on its own line, with its start, length
+     * and strand in the query, its MS pointer, and its document if the document array is used.
+     * Only these records are kept, so the MS of every position never reaches the output. With a
+     * locator, the matches of the query are located together and their occurrences are added.
+     */
+    auto is_mem = [&](size_t i) {return lengths[i] >= min_length && (i == 0 || lengths[i-1] <= lengths[i]);};
+    const size_t num_positions = std::min(lengths.size(), pointers.size());
+    if (locator != nullptr) {
+        for (size_t i = 0; i < num_positions; i++) {
+            if (is_mem(i)) {locator->add(i, std::min(lengths[i], query.size() - i));}
+        }
+        index->locate_matches(query, *locator);
+    }
 
-            Read read_struct;
-            bool valid_read = false;
+    char buf[96];
+    size_t match_id = 0;
+    for (size_t i = 0; i < num_positions; i++) {
+        if (!is_mem(i)) continue;
+        int len = (i < doc_nums.size()) ? std::snprintf(buf, sizeof(buf), "%zu\t%zu\t%c\t%zu\t%zu", i, lengths[i], strand, pointers[i], doc_nums[i])
+                                        : std::snprintf(buf, sizeof(buf), "%zu\t%zu\t%c\t%zu", i, lengths[i], strand, pointers[i]);
+        text.append(buf, len);
+        if (locator != nullptr) {
+            text.push_back('\t');
+            locator->append_occs(match_id++, text);
+        }
+        text.push_back('\n');
+    }
+}
 
-            // Iterates over reads in a single batch
-            while (true) {
-                valid_read = reader.grabNextRead(read_struct);
-                if (!valid_read) break;
-
-                // make sure all characters are upper-case
-                std::string curr_read = std::string(read_struct.seq);
-                transform(curr_read.begin(), curr_read.end(), curr_read.begin(), ::toupper); 
-
-                // convert to minimizer-form if needed
-                if (use_promotions)
-                    curr_read = perform_minimizer_digestion(curr_read, k, w);
-                else if (use_dna_letters)
-                    curr_read = perform_dna_minimizer_digestion(curr_read, k, w);
-                
-                // verify the read is not empty after digestion (special case)
-                if (curr_read.length() == 0){
-                    std::cout << "\n\n";
-                    FATAL_WARNING("%s was empty after digestion, commonly due to reads "
-                                  "consisting of mostly non-ACGT characters. Please remove " 
-                                  "read or run SPUMONI without minimizer digestion.", read_struct.id.data());
-                }
+void append_ref_coords(const SequenceTable& seq_table, const std::vector<size_t>& lengths, const std::vector<size_t>& pointers,
+                       size_t min_length, char strand, std::vector<RefCoord>& coords, std::string& text) {
+    /* 
+     * Places each maximal match at least min_length long in the reference. The matches of a read
+     * are looked up together in sorted order, and each one is written on its own line with its
+     * start, length and strand in the query, and its sequence, offset and strand in the reference.
+     */
+    coords.clear();
+    for (size_t i = 0; i < lengths.size() && i < pointers.size(); i++) {
+        if (lengths[i] < min_length || (i > 0 && lengths[i-1] > lengths[i])) continue;
+        RefCoord coord;
+        coord.query_pos = i;
+        coord.length = lengths[i];
+        coord.text_pos = pointers[i];
+        coords.push_back(coord);
+    }
+    seq_table.locate(coords);
+
+    char buf[64];
+    for (const auto& coord: coords) {
+        int len = std::snprintf(buf, sizeof(buf), "%zu\t%zu\t%c\t", coord.query_pos, coord.length, strand);
+        text.append(buf, len);
+        text.append(seq_table.names[coord.seq_id]);
+        len = std::snprintf(buf, sizeof(buf), "\t%zu\t%c\n", coord.offset, (coord.reverse) ? '-' : '+');
+        text.append(buf, len);
+    }
+}
 
-                // grab MS and write to output file
-                std::vector<size_t> lengths, doc_nums;
-                if (use_doc){
-                    pml->matching_statistics(curr_read.c_str(), curr_read.size(), lengths, doc_nums);
-                }
-                else {pml->matching_statistics(curr_read.c_str(), curr_read.size(), lengths);}
+void add_read_queries(const std::string& read, std::vector<std::string>& queries, MinimizerDigester& digester,
+                      bool use_digest, bool use_canonical, bool both_strands) {
+    /* Prepares the strands to query for an upper-case read, its reverse strand (if needed) goes right after it */
+    std::string curr_read(read), rc_read;
+    if (both_strands && !use_canonical) {RefBuilder::reverse_complement(curr_read, rc_read);}
+
+    // canonical minimizers of the reverse complement are the same ones reversed
+    if (use_digest) {
+        digester.digest(curr_read);
+        if (use_canonical) {digester.reverse_minimizers(curr_read, rc_read);}
+        else if (both_strands) {digester.digest(rc_read);}
+    }
+    queries.push_back(std::move(curr_read));
+    if (both_strands || use_canonical) {queries.push_back(std::move(rc_read));}
+}
 
-                
-                // perform the KS-test
-                /*
-                std::vector<double> ks_list;
-                std::string status = "";
-                size_t num_bin_above_thr = 0;
-                double sum_ks_stats = 0.0;
+size_t count_prefilter_hits(const Prefilter& prefilter, const std::vector<std::string>& queries) {
+    /* Returns the number of q-grams of the read found in the prefilter, using the strand with the most of them */
+    size_t num_hits = 0;
+    for (const auto& query: queries) {num_hits = std::max(num_hits, prefilter.count_hits(query.data(), query.length()));}
+    return num_hits;
+}
 
-                if (write_report) {
-                    // gather the kolomogorov-smirnov statistics
-                    ks_list = sig_test.run_kstest(lengths);
-                
-                    // classify the based on ks-statistics
-                    double threshold = sig_test.get_threshold();
-                    threshold = 0.10;
-                    for (size_t i = 0; i < ks_list.size(); i++) {
-                        if (ks_list[i] >= threshold) num_bin_above_thr++;
+std::vector<size_t> locality_order(const std::vector<std::string>& queries) {
+    /*
+     * Orders the queries of a batch by their last few symbols, which are the first ones
+     * consumed by backward search. Queries with the same key start in the same BWT range,
+     * so running them back to back keeps that part of the index in cache.
+     */
+    std::vector<uint64_t> keys(queries.size(), 0);
+    for (size_t i = 0; i < queries.size(); i++) {
+        const std::string& query = queries[i];
+        size_t num_symbols = std::min(query.length(), static_cast<size_t>(LOCALITY_KEY_SYMBOLS));
+        for (size_t j = 0; j < LOCALITY_KEY_SYMBOLS; j++) {
+            uint8_t symbol = (j < num_symbols) ? static_cast<uint8_t>(query[query.length() - 1 - j]) : 0;
+            keys[i] = (keys[i] << 8) | symbol;
+        }
+    }
+    std::vector<size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {return keys[a] < keys[b];});
+    return order;
+}
 
-                        // Added for debugging ....
-                        //ks_stat_file.precision(3);
-                        //ks_stat_file << ((i+1.0)/ks_list.size()) << "," << ks_list[i] << "," << threshold << "\n";
-                    }
-                    bool read_found = (num_bin_above_thr/(ks_list.size()+0.0) > 0.50);
+/* Values computed for one strand of a read */
+struct StrandValues {
+    std::vector<size_t> lengths; // MS or PML
+    std::vector<size_t> pointers; // MS pointers (empty for PML)
+    std::vector<size_t> doc_nums; // document numbers (empty if not requested)
 
-                    std::for_each(ks_list.begin(), ks_list.end(), [&] (double n) {sum_ks_stats += n;});
-                    status = (read_found) ? "FOUND" : "NOT_PRESENT";
-                } 
-                */
+    void clear() {lengths.clear(); pointers.clear(); doc_nums.clear();}
+};
 
-                std::vector<size_t> bins_max_value;
-                std::string status = "";
-                size_t sum_max_bin_values = 0.0;
-                size_t bins_above = 0, bins_below = 0;
-                size_t start_pos = 0, end_pos = 0;
+/* Values of a read after the strands are merged, and the records of its maximal matches */
+struct ReadResult {
+    StrandValues values;
+    std::string strands; // strand kept at each position (empty if only the read was queried)
+    std::string list_text, coords_text, mems_text;
+    bool rejected = false; // failed the prefilter, so it has no values
+
+    void clear() {
+        values.clear(); strands.clear();
+        list_text.clear(); coords_text.clear(); mems_text.clear();
+        rejected = false;
+    }
+};
 
-                if (write_report) {
-                    while (start_pos < lengths.size()) {
-                        end_pos = (start_pos + bin_width < lengths.size()) ? start_pos + bin_width : lengths.size();
-                        
-                        // avoids small regions at the end of read
-                        if (lengths.size() - end_pos < bin_width)
-                            end_pos = lengths.size();
+/* Differences between the PML and MS runs, everything else is shared by classify_reads */
+template <class index_t> struct ClassifyTraits;
 
-                        // grab maximum value in this region and update variables
-                        auto max_val = *std::max_element(lengths.begin()+start_pos, lengths.begin()+end_pos);
-                        if (max_val >= max_value_thr)
-                            bins_above++;
-                        else
-                            bins_below++;
-                        bins_max_value.push_back(max_val);
-                        start_pos += (end_pos - start_pos);
-                    }
-                    std::for_each(bins_max_value.begin(), bins_max_value.end(), [&] (double n) {sum_max_bin_values += n;});
-                    bool read_found = (bins_above/(bins_above+bins_below+0.0) > 0.50);
-                    status = (read_found) ? "FOUND" : "NOT_PRESENT";
-                }
+template <> struct ClassifyTraits<pml_t> {
+    static constexpr const char* func = "compute_pml";
+    static constexpr const char* null_db_extension = ".pmlnulldb";
+    static constexpr const char* lengths_extension = ".pseudo_lengths";
+    static constexpr bool has_pointers = false;
+    static constexpr size_t general_thr_offset = 4; // added to the null threshold for reads that are not digested
+};
 
-                #pragma omp atomic
-                num_reads++;
+template <> struct ClassifyTraits<ms_t> {
+    static constexpr const char* func = "compute_ms";
+    static constexpr const char* null_db_extension = ".msnulldb";
+    static constexpr const char* lengths_extension = ".lengths";
+    static constexpr bool has_pointers = true;
+    static constexpr size_t general_thr_offset = 0;
+};
 
-                // output the statistics requested
-                #pragma omp critical
-                {
-                    if (use_doc) {
-                        doc_file << '>' << read_struct.id << '\n';
-                        std::copy(doc_nums.begin(), doc_nums.end(), doc_iter);
-                        doc_file << '\n';
-                    }
-                    lengths_file << '>' << read_struct.id << '\n';
-                    std::copy(lengths.begin(), lengths.end(), lengths_iter);
-                    lengths_file << '\n'; 
-                    
-                    if (write_report) {
-                        report_file.precision(3);
-                        report_file << std::setw(30) << std::left << read_struct.id
-                                    << std::setw(15) << std::left << status 
-                                    << std::setw(26) << std::left <<  (sum_max_bin_values+0.0)/bins_max_value.size() // (sum_ks_stats/ks_list.size()) 
-                                    << std::setw(12) << std::left <<  bins_above // num_bin_above_thr
-                                    << std::setw(12) << std::left <<  bins_below // (ks_list.size() - num_bin_above_thr)
-                                    << std::endl;
-                    }
-                }
-            } // End of read while loop
-        } // End of batch while loop
-    } // End of parallel region
+void query_strand(pml_t* pml, MinimizerDigester& digester, const std::string& query, bool streaming,
+                  bool use_doc, StrandValues& values) {
+    /* Computes the PMLs of one strand, when streaming the minimizers are digested during backward search */
+    if (streaming) {
+        if (use_doc) {pml->streaming_statistics(digester, query.c_str(), query.size(), values.lengths, values.doc_nums);}
+        else {pml->streaming_statistics(digester, query.c_str(), query.size(), values.lengths);}
+    } else if (use_doc) {
+        pml->matching_statistics(query.c_str(), query.size(), values.lengths, values.doc_nums);
+    } else {pml->matching_statistics(query.c_str(), query.size(), values.lengths);}
+}
 
-    lengths_file.close();
-    input_file.close();
+void query_strand(ms_t* ms, MinimizerDigester& digester, const std::string& query, bool streaming,
+                  bool use_doc, StrandValues& values) {
+    /* Computes the MSs of one strand, the query is always digested beforehand */
+    if (use_doc) {ms->matching_statistics(query.c_str(), query.size(), values.lengths, values.pointers, values.doc_nums);}
+    else {ms->matching_statistics(query.c_str(), query.size(), values.lengths, values.pointers);}
+}
 
-    //ks_stat_file.close();
+size_t query_suffix_batch(pml_t* pml, const std::vector<std::string>& queries, bool use_doc, std::vector<StrandValues>& results) {
+    /* Computes the PMLs of a batch of queries together, and returns the number of steps shared between them */
+    std::vector<std::vector<size_t>> lengths, doc_nums;
+    size_t reused_steps = pml->batch_statistics(queries, lengths, doc_nums, use_doc);
 
-    if (use_doc) {doc_file.close();}
-    if (write_report) {report_file.close();}
-    return num_reads;
+    results.resize(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        results[i].lengths.swap(lengths[i]);
+        if (use_doc) {results[i].doc_nums.swap(doc_nums[i]);}
+    }
+    return reused_steps;
 }
 
-size_t classify_reads_ms(ms_t *ms, std::string ref_filename, std::string pattern_filename, 
-                         bool use_doc, bool min_digest, bool write_report, size_t num_threads,
-                         size_t k, size_t w, bool use_promotions, bool use_dna_letters, size_t bin_width) {
+size_t query_suffix_batch(ms_t* ms, const std::vector<std::string>& queries, bool use_doc, std::vector<StrandValues>& results) {
+    /* Computes the MSs of a batch of queries together, and returns the number of steps shared between them */
+    std::vector<std::vector<size_t>> lengths, pointers, doc_nums;
+    size_t reused_steps = ms->batch_statistics(queries, lengths, pointers, doc_nums, use_doc);
 
-    // declare output files, and output iterators
-    std::ofstream lengths_file (pattern_filename + ".lengths");
-    std::ofstream pointers_file (pattern_filename + ".pointers");
-    std::ofstream doc_file, report_file;
+    results.resize(queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        results[i].lengths.swap(lengths[i]);
+        results[i].pointers.swap(pointers[i]);
+        if (use_doc) {results[i].doc_nums.swap(doc_nums[i]);}
+    }
+    return reused_steps;
+}
 
-    std::ostream_iterator<size_t> length_iter (lengths_file, " ");
-    std::ostream_iterator<size_t> pointers_iter (pointers_file, " ");
-    std::ostream_iterator<size_t> doc_iter (doc_file, " ");
+/*
+ * Takes each read of a task through the same steps for PML and MS: the cache lookup,
+ * preparing (and digesting) the strands, the prefilter, querying each strand, writing
+ * the records of its maximal matches, and merging the strands. Each thread has its own
+ * pipeline on the copy of the index local to it.
+ */
+template <class index_t>
+class ReadPipeline {
+public:
+    size_t num_steps = 0, num_reused_steps = 0, num_rejected = 0;
+    DocumentLister lister;
+    MatchLocator locator;
+
+    ReadPipeline(index_t* index, const SpumoniRunOptions* run_opts, const Prefilter* prefilter,
+                 ReadCache* dedup_cache, const SequenceTable* seq_table):
+        lister(run_opts->doc_list_max_steps), locator(run_opts->max_mem_occs), index(index), run_opts(run_opts),
+        prefilter(prefilter), dedup_cache(dedup_cache), seq_table(seq_table), kernels(get_cpu_kernels()),
+        digester(run_opts->k, run_opts->w, run_opts->use_promotions, run_opts->use_canonical) {
+        /* Sets the flags of each step once, from the options of the run */
+        use_doc = run_opts->use_doc;
+        use_digest = run_opts->use_promotions || run_opts->use_dna_letters;
+        use_canonical = run_opts->use_canonical;
+        both_strands = run_opts->both_strands;
+        query_reverse = both_strands || use_canonical;
+        suffix_batch = run_opts->suffix_batch;
+        batch_mode = suffix_batch || run_opts->reorder_reads;
+
+        // PML can digest the minimizers inside backward search, but only if nothing else needs the digested strands:
+        // the prefilter counts their q-grams, document lists are written on them, and canonical strands are reversed
+        streaming = !ClassifyTraits<index_t>::has_pointers && use_digest && !use_canonical && !batch_mode &&
+                    !prefilter && !run_opts->doc_list_length;
+    }
+
+    void query_batch(ReadTask& task) {
+        /* Prepares the strands of every read in the task and queries them together, next_read then takes their results */
+        Read read;
+        batch_reads.clear(); batch_queries.clear();
+        batch_pos = 0;
+        while (task.grabNextRead(read)) {
+            curr_read.assign(read.seq);
+            kernels.to_upper(&curr_read[0], curr_read.length());
+            add_read_queries(curr_read, batch_queries, digester, use_digest, use_canonical, both_strands);
+            batch_reads.push_back(std::move(read));
+        }
+
+        if (suffix_batch) {
+            for (const auto& query: batch_queries) {num_steps += query.length();}
+            num_reused_steps += query_suffix_batch(index, batch_queries, use_doc, batch_values);
+        } else {
+            // similar reads run back to back, and results stay in input order
+            batch_values.resize(batch_queries.size());
+            for (size_t query_id: locality_order(batch_queries))
+                query_strand(index, digester, batch_queries[query_id], false, use_doc, batch_values[query_id]);
+        }
+    }
+
+    bool next_read(ReadTask& task, Read& read, ReadResult& result) {
+        /* Takes the next read, and fills in its result from the batch, the cache or the index. Returns false when none are left */
+        result.clear();
+        rc_values.clear();
+
+        // the batch was already queried, so take the results of this read
+        if (batch_mode) {
+            if (batch_pos == batch_reads.size()) return false;
+            size_t query_id = (query_reverse) ? (2 * batch_pos) : batch_pos;
+            read = std::move(batch_reads[batch_pos++]);
+
+            result.values = std::move(batch_values[query_id]);
+            if (query_reverse) {rc_values = std::move(batch_values[query_id+1]);}
+            merge_strands(batch_queries, query_id, result);
+            return true;
+        }
+
+        if (!task.grabNextRead(read)) return false;
+        curr_read.assign(read.seq);
+        kernels.to_upper(&curr_read[0], curr_read.length());
+
+        // rejected reads are never cached, so an identical read that is cached has passed the prefilter
+        auto cached = (dedup_cache) ? dedup_cache->find(curr_read) : nullptr;
+        if (cached) {
+            result.values.lengths = cached->lengths;
+            result.values.pointers = cached->pointers;
+            result.values.doc_nums = cached->doc_nums;
+            result.strands = cached->strands;
+            return true;
+        }
+
+        // when streaming, backward search digests the strands itself
+        queries.clear();
+        if (streaming) {
+            queries.push_back(curr_read);
+            if (both_strands) {queries.emplace_back(); RefBuilder::reverse_complement(curr_read, queries.back());}
+        } else {add_read_queries(curr_read, queries, digester, use_digest, use_canonical, both_strands);}
+
+        // reads that fail the prefilter are reported as not present, with no values
+        if (prefilter && count_prefilter_hits(*prefilter, queries) < run_opts->prefilter_hits) {
+            result.rejected = true;
+            num_rejected++;
+            return true;
+        }
 
-    if (use_doc) {doc_file.open(pattern_filename + ".doc_numbers", std::ofstream::out);}
+        query_strand(index, digester, queries[0], streaming, use_doc, result.values);
+        if (query_reverse) {query_strand(index, digester, queries[1], streaming, use_doc, rc_values);}
+        merge_strands(queries, 0, result);
+
+        if (dedup_cache) {
+            auto cached_result = std::make_shared<CachedResult>();
+            cached_result->lengths = result.values.lengths;
+            cached_result->pointers = result.values.pointers;
+            cached_result->doc_nums = result.values.doc_nums;
+            cached_result->strands = result.strands;
+            dedup_cache->insert(curr_read, std::move(cached_result));
+        }
+        return true;
+    }
+
+private:
+    index_t* index = nullptr;
+    const SpumoniRunOptions* run_opts = nullptr;
+    const Prefilter* prefilter = nullptr;
+    ReadCache* dedup_cache = nullptr;
+    const SequenceTable* seq_table = nullptr;
+    const CpuKernels& kernels;
+    MinimizerDigester digester;
+
+    bool use_doc = false, use_digest = false, use_canonical = false, both_strands = false;
+    bool query_reverse = false, suffix_batch = false, batch_mode = false, streaming = false;
+
+    // buffers reused for every read of this thread
+    std::string curr_read = "";
+    std::vector<std::string> queries;
+    StrandValues rc_values;
+    std::vector<RefCoord> coords;
+
+    // reads and results of the current batch, for suffix batching or reordering
+    std::vector<Read> batch_reads;
+    std::vector<std::string> batch_queries;
+    std::vector<StrandValues> batch_values;
+    size_t batch_pos = 0;
+
+    void append_records(const std::string& query, const StrandValues& values, char strand, ReadResult& result) {
+        /* Writes the records of the maximal matches of one strand, for each kind of record requested */
+        if (run_opts->doc_list_length) {
+            append_doc_lists(index, query, values.lengths, run_opts->doc_list_length, strand, lister, result.list_text);
+        }
+        if constexpr (ClassifyTraits<index_t>::has_pointers) {
+            if (run_opts->ref_coords_length) {
+                append_ref_coords(*seq_table, values.lengths, values.pointers, run_opts->ref_coords_length, strand, coords, result.coords_text);
+            }
+            if (run_opts->mem_length) {
+                append_mems(index, query, values.lengths, values.pointers, values.doc_nums, run_opts->mem_length, strand,
+                            (run_opts->locate_mems) ? &locator : nullptr, result.mems_text);
+            }
+        }
+    }
+
+    void merge_strands(const std::vector<std::string>& strand_queries, size_t query_id, ReadResult& result) {
+        /* Writes the records of each strand before they are merged, then keeps the longer match at each position */
+        append_records(strand_queries[query_id], result.values, '+', result);
+        if (!query_reverse) return;
+        append_records(strand_queries[query_id+1], rc_values, '-', result);
+
+        // lengths are taken last, since the other values are chosen by comparing them
+        StrandValues& values = result.values;
+        if (use_doc) {take_reverse_strand(values.lengths, rc_values.lengths, values.doc_nums, rc_values.doc_nums);}
+        if (ClassifyTraits<index_t>::has_pointers) {take_reverse_strand(values.lengths, rc_values.lengths, values.pointers, rc_values.pointers);}
+        mark_reverse_strand(values.lengths, rc_values.lengths, result.strands);
+        take_reverse_strand(values.lengths, rc_values.lengths, values.lengths, rc_values.lengths);
+    }
+};
+
+template <class index_t>
+size_t classify_reads(std::vector<index_t*>& replicas, SpumoniRunOptions* run_opts,
+                      const NumaTopology& topology, std::vector<NodeStats>& node_stats) {
+    /* computes the MSs or PMLs for each read, and uses the index replica local to each thread */
+    using traits = ClassifyTraits<index_t>;
+    const char* func = traits::func;
+    std::string ref_filename = run_opts->ref_file, pattern_filename = run_opts->pattern_file;
+    bool use_doc = run_opts->use_doc, write_report = run_opts->write_report;
+    bool use_promotions = run_opts->use_promotions, use_dna_letters = run_opts->use_dna_letters;
+    bool use_numa = (run_opts->numa_placement != NUMA_OFF);
+    bool query_reverse = run_opts->both_strands || run_opts->use_canonical;
+    bool suffix_batch = run_opts->suffix_batch, batch_mode = suffix_batch || run_opts->reorder_reads;
+    size_t total_steps = 0, total_reused_steps = 0;
+    size_t total_run_hits = 0, total_run_misses = 0;
+    size_t doc_list_length = run_opts->doc_list_length;
+    size_t total_listed = 0, total_listed_docs = 0, total_truncated = 0;
+    bool use_vote = (run_opts->doc_vote != VOTE_OFF);
+    DocumentVoter all_votes(run_opts->doc_vote, (use_vote) ? &replicas[0]->doc_arr : nullptr);
+    size_t ref_coords_length = run_opts->ref_coords_length;
+    size_t mem_length = run_opts->mem_length, total_mem_bytes = 0;
+    bool locate_mems = run_opts->locate_mems;
+    size_t total_located_mems = 0, total_mem_occs = 0, total_capped_mems = 0;
+
+    // identical reads share their results, if there is memory for the cache
+    std::unique_ptr<ReadCache> dedup_cache;
+    if (run_opts->dedup_cache_mb > 0) {dedup_cache.reset(new ReadCache(run_opts->dedup_cache_mb * 1024 * 1024));}
+    size_t num_threads = run_opts->threads, bin_width = run_opts->bin_size;
+
+    // Added for debugging ....
+    //std::ofstream ks_stat_file (pattern_filename + ".ks_stats");
+
+    // declare output files, the MEM records replace the per-position outputs
+    std::ofstream lengths_file, pointers_file, mems_file;
+    std::ofstream doc_file, report_file;
+    bool write_positions = (mem_length == 0), write_doc_numbers = use_doc && !use_vote && write_positions;
+    bool write_pointers = traits::has_pointers && write_positions;
+    if (write_positions) {lengths_file.open(pattern_filename + traits::lengths_extension, std::ofstream::out);}
+    else {mems_file.open(pattern_filename + ".mems", std::ofstream::out);}
+    if (write_pointers) {pointers_file.open(pattern_filename + ".pointers", std::ofstream::out);}
+
+    std::ofstream list_file, vote_file, coords_file;
+    if (ref_coords_length > 0) {coords_file.open(pattern_filename + ".ref_coords", std::ofstream::out);}
+    if (write_doc_numbers) {doc_file.open(pattern_filename + ".doc_numbers", std::ofstream::out);}
+
+    // with both strands, the strand kept at each position, since documents and pointers can come from either
+    std::ofstream strands_file;
+    bool write_strands = query_reverse && write_positions;
+    if (write_strands) {strands_file.open(pattern_filename + ".strands", std::ofstream::out);}
+    if (use_vote) {vote_file.open(pattern_filename + ".doc_votes");}
+    if (doc_list_length > 0) {list_file.open(pattern_filename + ".doc_lists", std::ofstream::out);}
     if (write_report) {report_file.open(pattern_filename + ".report", std::ofstream::out);}
-    //KSTest sig_test(ref_filename.data(), MS, write_report, report_file, bin_width);
+    //KSTest sig_test (ref_filename.data(), PML, write_report, report_file, bin_width);
 
-    // load empirical null pml database, and prepare output report if requested
+    // load empirical null database, and prepare output report if requested
     EmpNullDatabase null_db;
-    std::string null_db_path = ref_filename + ".msnulldb";
+    std::string null_db_path = ref_filename + traits::null_db_extension;
 
     std::ifstream in(null_db_path);
     null_db.load(in);
     in.close();
 
-    size_t max_value_thr = std::max(null_db.percentile_value, 3.0); 
+    // reads with too few q-grams in the prefilter are classified without querying the index
+    std::unique_ptr<Prefilter> prefilter;
+    size_t total_rejected = 0;
+    if (run_opts->prefilter_hits > 0) {
+        prefilter.reset(new Prefilter());
+        std::ifstream prefilter_in(ref_filename + ".prefilter", std::ios::binary);
+        prefilter->load(prefilter_in);
+    }
+
+    // boundaries of the reference sequences, for placing matches in the reference
+    SequenceTable seq_table;
+    if (ref_coords_length > 0) {
+        std::ifstream seq_table_in(ref_filename + SequenceTable::get_file_extension(), std::ios::binary);
+        seq_table.load(seq_table_in);
+    }
+
+    size_t max_value_thr = std::max(null_db.percentile_value, 3.0);
     if (use_dna_letters)
         max_value_thr++;
+    else if (!use_dna_letters && !use_promotions)
+        max_value_thr += traits::general_thr_offset;
 
-    if (write_report) {    
+    if (write_report) {
         report_file.precision(4);
         report_file << std::setw(30) << std::left << "read id:"
-                    << std::setw(15) << std::left << "status:" 
-                    << std::setw(19) << std::left << "avg max-value (thr=" 
+                    << std::setw(15) << std::left << "status:"
+                    << std::setw(19) << std::left << "avg max-value (thr="
                     << std::setw(2) << std::left << max_value_thr
-                    << std::setw(5) << std::left << "):" 
+                    << std::setw(5) << std::left << "):"
                     << std::setw(12) << std::left << "above thr:"
                     << std::setw(12) << std::left << "below thr:" << std::endl;
     }
 
     // open query file, and start to classify
     std::ifstream input_file (pattern_filename.c_str());
-    omp_set_num_threads(num_threads); 
+    omp_set_num_threads(num_threads);
     size_t num_reads = 0;
     srand(0);
 
+    // batched modes need whole large batches, otherwise tasks are sized by how long they take
+    ReadScheduler scheduler (input_file, num_threads, (batch_mode) ? LARGE_BATCH_BASES : SCHED_MIN_TASK_BASES,
+                             (batch_mode) ? LARGE_BATCH_BASES : SCHED_MAX_TASK_BASES);
+
     #pragma omp parallel
     {
-        BatchLoader reader;
-
-        // Iterates over batches of data until none left
-        while (true) {
-            bool valid_batch = true;
-            #pragma omp critical // one reader at a time
-            {
-                valid_batch = reader.loadBatch(input_file, 1000);
-            }
-            if (!valid_batch) break;
-
-            Read read_struct;
-            bool valid_read = false;
+        ReadTask task;
+        Read read_struct;
+        ReadResult result;
+        NodeStats thread_stats;
+        const CpuKernels& kernels = get_cpu_kernels();
+        std::string lengths_text, pointers_text, doc_text, vote_text;
+        DocumentVoter voter(run_opts->doc_vote, (use_vote) ? &replicas[0]->doc_arr : nullptr); // labels are the same in every copy
+        size_t thread_mem_bytes = 0;
+        RunCache::this_thread().reset_counters();
+
+        // pin thread to its node, and use the copy of the index on that node
+        size_t thread_id = omp_get_thread_num();
+        size_t node = topology.node_of_thread(thread_id);
+        if (use_numa) {topology.pin_thread(thread_id);}
+        ReadPipeline<index_t> pipeline (replicas[(node < replicas.size()) ? node : 0], run_opts, prefilter.get(),
+                                        dedup_cache.get(), &seq_table);
+
+        // Iterates over tasks of reads until none left, stealing from other threads when out of work
+        while (scheduler.next_task(thread_id, task)) {
+            auto task_start = std::chrono::steady_clock::now();
+
+            // with suffix batching or reordering, every read in the batch is queried before any output
+            if (batch_mode) {pipeline.query_batch(task);}
 
             // Iterates over reads in a single batch
-            while (true) {
-                valid_read = reader.grabNextRead(read_struct);
-                if (!valid_read) break;
-
-                // make sure all characters are upper-case
-                std::string curr_read = std::string(read_struct.seq);
-                transform(curr_read.begin(), curr_read.end(), curr_read.begin(), ::toupper); 
-
-                // convert to minimizer-form if needed
-                if (use_promotions)
-                    curr_read = perform_minimizer_digestion(curr_read, k, w);
-                else if (use_dna_letters)
-                    curr_read = perform_dna_minimizer_digestion(curr_read, k, w);
+            while (pipeline.next_read(task, read_struct, result)) {
+                const std::vector<size_t>& lengths = result.values.lengths;
 
                 // verify the read is not empty after digestion (special case)
-                if (curr_read.length() == 0){
+                if (lengths.size() == 0 && !result.rejected){
                     std::cout << "\n\n";
                     FATAL_WARNING("%s was empty after digestion, commonly due to reads "
-                                  "consisting of mostly non-ACGT characters. Please remove " 
+                                  "consisting of mostly non-ACGT characters. Please remove "
                                   "read or run SPUMONI without minimizer digestion.", read_struct.id.data());
-                } 
-
-                // grab MS and write to output file
-                std::vector<size_t> lengths, pointers, doc_nums;
-                if (use_doc){
-                    ms->matching_statistics(curr_read.c_str(), curr_read.size(), lengths, pointers, doc_nums);
                 }
-                else {ms->matching_statistics(curr_read.c_str(), curr_read.size(), lengths, pointers);}
 
-                /*
                 // perform the KS-test
+                /*
                 std::vector<double> ks_list;
                 std::string status = "";
                 size_t num_bin_above_thr = 0;
@@ -1118,17 +2191,23 @@ size_t classify_reads_ms(ms_t *ms, std::string ref_filename, std::string pattern
                 if (write_report) {
                     // gather the kolomogorov-smirnov statistics
                     ks_list = sig_test.run_kstest(lengths);
-                
+
                     // classify the based on ks-statistics
                     double threshold = sig_test.get_threshold();
+                    threshold = 0.10;
                     for (size_t i = 0; i < ks_list.size(); i++) {
                         if (ks_list[i] >= threshold) num_bin_above_thr++;
+
+                        // Added for debugging ....
+                        //ks_stat_file.precision(3);
+                        //ks_stat_file << ((i+1.0)/ks_list.size()) << "," << ks_list[i] << "," << threshold << "\n";
                     }
                     bool read_found = (num_bin_above_thr/(ks_list.size()+0.0) > 0.50);
 
                     std::for_each(ks_list.begin(), ks_list.end(), [&] (double n) {sum_ks_stats += n;});
                     status = (read_found) ? "FOUND" : "NOT_PRESENT";
-                }*/
+                }
+                */
 
                 std::vector<size_t> bins_max_value;
                 std::string status = "";
@@ -1139,13 +2218,13 @@ size_t classify_reads_ms(ms_t *ms, std::string ref_filename, std::string pattern
                 if (write_report) {
                     while (start_pos < lengths.size()) {
                         end_pos = (start_pos + bin_width < lengths.size()) ? start_pos + bin_width : lengths.size();
-                        
+
                         // avoids small regions at the end of read
                         if (lengths.size() - end_pos < bin_width)
                             end_pos = lengths.size();
 
                         // grab maximum value in this region and update variables
-                        auto max_val = *std::max_element(lengths.begin()+start_pos, lengths.begin()+end_pos);
+                        auto max_val = kernels.max_value(lengths.data()+start_pos, end_pos-start_pos);
                         if (max_val >= max_value_thr)
                             bins_above++;
                         else
@@ -1154,51 +2233,141 @@ size_t classify_reads_ms(ms_t *ms, std::string ref_filename, std::string pattern
                         start_pos += (end_pos - start_pos);
                     }
                     std::for_each(bins_max_value.begin(), bins_max_value.end(), [&] (double n) {sum_max_bin_values += n;});
-                    bool read_found = (bins_above/(bins_above+bins_below+0.0) > 0.50);
+                    bool read_found = (bins_above + bins_below > 0) && (bins_above/(bins_above+bins_below+0.0) > 0.50);
                     status = (read_found) ? "FOUND" : "NOT_PRESENT";
+
+                    // reads rejected by the prefilter have no bins, so their status is set directly
+                    if (result.rejected) {status = "NOT_PRESENT";}
                 }
 
                 #pragma omp atomic
                 num_reads++;
 
+                thread_stats.reads++;
+                thread_stats.bases += read_struct.seq.length();
+
+                // format the statistics before entering critical section
+                lengths_text.clear(); pointers_text.clear(); doc_text.clear();
+                if (write_positions) {append_values(lengths_text, lengths.data(), lengths.size());}
+                if (write_pointers) {append_values(pointers_text, result.values.pointers.data(), result.values.pointers.size());}
+                if (write_doc_numbers) {append_values(doc_text, result.values.doc_nums.data(), result.values.doc_nums.size());}
+                thread_mem_bytes += result.mems_text.size();
+                if (use_vote) {
+                    vote_text.clear();
+                    voter.vote(lengths, result.values.doc_nums);
+                    voter.append_assignment(vote_text);
+                }
+
                 // output the statistics requested
                 #pragma omp critical
                 {
-                    if (use_doc) {
-                        doc_file << '>' << read_struct.id << '\n';
-                        std::copy(doc_nums.begin(), doc_nums.end(), doc_iter);
-                        doc_file << '\n';
+                    if (write_doc_numbers) {
+                        doc_file << '>' << read_struct.id << '\n' << doc_text << '\n';
                     }
-                    lengths_file << '>' << read_struct.id << '\n';
-                    pointers_file << '>' << read_struct.id << '\n';
-
-                    std::copy(lengths.begin(), lengths.end(), length_iter);
-                    std::copy(pointers.begin(), pointers.end(), pointers_iter);
-                    lengths_file << '\n'; pointers_file << '\n';
+                    if (use_vote) {vote_file << read_struct.id << '\t' << vote_text << '\n';}
+                    if (doc_list_length) {list_file << '>' << read_struct.id << '\n' << result.list_text;}
+                    if (ref_coords_length) {coords_file << '>' << read_struct.id << '\n' << result.coords_text;}
+                    if (write_positions) {
+                        lengths_file << '>' << read_struct.id << '\n' << lengths_text << '\n';
+                        if (write_pointers) {pointers_file << '>' << read_struct.id << '\n' << pointers_text << '\n';}
+                        if (write_strands) {strands_file << '>' << read_struct.id << '\n' << result.strands << '\n';}
+                    } else {mems_file << '>' << read_struct.id << '\n' << result.mems_text;}
 
                     if (write_report) {
                         report_file.precision(3);
                         report_file << std::setw(30) << std::left << read_struct.id
-                                    << std::setw(15) << std::left << status 
-                                    << std::setw(26) << std::left << (sum_max_bin_values+0.0)/bins_max_value.size() //(sum_ks_stats/ks_list.size()) 
-                                    << std::setw(12) << std::left << bins_above //num_bin_above_thr
-                                    << std::setw(12) << std::left << bins_below //(ks_list.size() - num_bin_above_thr)
+                                    << std::setw(15) << std::left << status
+                                    << std::setw(26) << std::left << ((bins_max_value.size()) ? (sum_max_bin_values+0.0)/bins_max_value.size() : 0.0) // (sum_ks_stats/ks_list.size())
+                                    << std::setw(12) << std::left << bins_above // num_bin_above_thr
+                                    << std::setw(12) << std::left << bins_below // (ks_list.size() - num_bin_above_thr)
                                     << std::endl;
                     }
                 }
             } // End of read while loop
+            scheduler.record_task(task.num_bases, std::chrono::duration<double>(std::chrono::steady_clock::now() - task_start).count());
         } // End of batch while loop
+
+        #pragma omp critical
+        {
+            node_stats[node].reads += thread_stats.reads;
+            node_stats[node].bases += thread_stats.bases;
+            total_steps += pipeline.num_steps;
+            total_reused_steps += pipeline.num_reused_steps;
+            total_rejected += pipeline.num_rejected;
+            total_mem_bytes += thread_mem_bytes;
+            total_located_mems += pipeline.locator.num_matches;
+            total_mem_occs += pipeline.locator.num_occs;
+            total_capped_mems += pipeline.locator.num_capped;
+            total_run_hits += RunCache::this_thread().num_hits;
+            total_run_misses += RunCache::this_thread().num_misses;
+            total_listed += pipeline.lister.num_matches;
+            total_listed_docs += pipeline.lister.num_docs;
+            total_truncated += pipeline.lister.num_truncated;
+            all_votes.merge(voter);
+        }
     } // End of parallel region
 
     input_file.close();
-    lengths_file.close();
-    pointers_file.close();
+    if (write_positions) {lengths_file.close();}
+    else {mems_file.close();}
 
-    if (use_doc) {doc_file.close();}
+    //ks_stat_file.close();
+
+    if (write_pointers) {pointers_file.close();}
+    if (write_doc_numbers) {doc_file.close();}
+    if (doc_list_length) {list_file.close();}
+    if (ref_coords_length) {coords_file.close();}
+    if (write_strands) {strands_file.close();}
     if (write_report) {report_file.close();}
+
+    scheduler.print_stats(func);
+    if (prefilter) {
+        FORCE_LOG(func, "prefilter rejected %ld of %ld reads (%.1f%%)", total_rejected, num_reads,
+                  (num_reads) ? (100.0 * total_rejected / num_reads) : 0.0);
+    }
+    if (dedup_cache) {dedup_cache->print_stats(func);}
+    if (use_vote) {
+        vote_file.close();
+        std::ofstream abundance_file(pattern_filename + ".abundance");
+        all_votes.write_abundance(abundance_file);
+        abundance_file.close();
+        FORCE_LOG(func, "document vote assigned %ld of %ld reads to a document",
+                  all_votes.num_reads - all_votes.num_unassigned[0], all_votes.num_reads);
+    }
+    if (mem_length) {
+        FORCE_LOG(func, "wrote %.1f MB of MEM records at least %ld long", total_mem_bytes/(1024.0 * 1024.0), mem_length);
+    }
+    if (locate_mems) {
+        FORCE_LOG(func, "located %ld occurrences of %ld MEMs (%.1f per MEM, %ld capped)", total_mem_occs, total_located_mems,
+                  (total_located_mems) ? (total_mem_occs + 0.0) / total_located_mems : 0.0, total_capped_mems);
+    }
+    if (doc_list_length) {
+        FORCE_LOG(func, "listed the documents of %ld maximal matches (%.1f documents per match, %ld cut short)",
+                  total_listed, (total_listed) ? (total_listed_docs + 0.0) / total_listed : 0.0, total_truncated);
+    }
+    if (total_run_hits + total_run_misses > 0) {
+        FORCE_LOG(func, "run cache: %ld hits, %ld misses (%.1f%% hit rate)", total_run_hits, total_run_misses,
+                  100.0 * total_run_hits / (total_run_hits + total_run_misses));
+    }
+    if (suffix_batch && total_steps > 0) {
+        FORCE_LOG(func, "suffix batching reused %.1f%% of the backward-search steps",
+                  100.0 * total_reused_steps / total_steps);
+    }
     return num_reads;
 }
 
+size_t classify_reads_pml(std::vector<pml_t*>& replicas, SpumoniRunOptions* run_opts,
+                          const NumaTopology& topology, std::vector<NodeStats>& node_stats) {
+    /* computes the PMLs for each read, and uses the index replica local to each thread */
+    return classify_reads(replicas, run_opts, topology, node_stats);
+}
+
+size_t classify_reads_ms(std::vector<ms_t*>& replicas, SpumoniRunOptions* run_opts,
+                         const NumaTopology& topology, std::vector<NodeStats>& node_stats) {
+    /* computes the MSs for each read, and uses the index replica local to each thread */
+    return classify_reads(replicas, run_opts, topology, node_stats);
+}
+
 size_t classify_general_reads_ms(ms_t *ms, std::string ref_filename, std::string pattern_filename) {
     /* generates the MS for general-text reads against a general text reference */
 
@@ -1285,11 +2454,27 @@ size_t classify_general_reads_pml(pml_t *pml, std::string ref_filename, std::str
  * given the index and pattern.
  */
 
+void check_canonical_index(const std::string& null_db_path, bool use_canonical) {
+    /* Stops if the reads would be digested differently than the index, which keeps the flag in its null database */
+    EmpNullDatabase null_db;
+    std::ifstream in(null_db_path);
+    null_db.load(in);
+    in.close();
+
+    if (null_db.use_canonical && !use_canonical)
+        FATAL_ERROR("The index was built with canonical minimizers, please add -C to digest the reads the same way.");
+    if (!null_db.use_canonical && use_canonical)
+        FATAL_ERROR("The index was not built with canonical minimizers, please remove -C.");
+}
+
 int run_spumoni_main(SpumoniRunOptions* run_opts){
     /* This method is responsible for the PML computation */
 
-    // Loads the RLEBWT and Thresholds
-    pml_t ms(run_opts->ref_file, run_opts->use_doc, true);
+    // Loads the RLEBWT and Thresholds, on the NUMA nodes if requested
+    check_canonical_index(run_opts->ref_file + ".pmlnulldb", run_opts->use_canonical);
+    NumaTopology topology;
+    std::vector<pml_t*> replicas = load_index_replicas<pml_t>(run_opts, topology, "compute_pml");
+    std::vector<NodeStats> node_stats (topology.num_nodes());
     std::string out_filename = run_opts->pattern_file;
     std::cout << std::endl;
 
@@ -1302,6 +2487,21 @@ int run_spumoni_main(SpumoniRunOptions* run_opts){
                   run_opts->k, run_opts->w);
     else
         FORCE_LOG("compute_pml", "input reads will be used directly, no minimizer digestion");
+    print_cpu_kernels("compute_pml");
+
+    // Choose the query kernel specialized for the alphabet of the reads
+    alphabet_type query_alphabet = get_query_alphabet(run_opts->is_general_text, run_opts->use_promotions);
+    for (auto replica: replicas) {replica->select_query_kernels(query_alphabet);}
+    FORCE_LOG("compute_pml", "query kernel is specialized for the %s alphabet", get_alphabet_name(query_alphabet));
+    FORCE_LOG("compute_pml", "index uses the %s rlbwt and the %s thresholds data-structure", 
+              get_rlbwt_name(replicas[0]->get_rlbwt_type()).data(),
+              get_thresholds_name(replicas[0]->get_thresholds_type()).data());
+    if (run_opts->doc_list_length > 0 && !replicas[0]->doc_arr.has_doc_starts())
+        FATAL_ERROR("Listing documents (-l) needs the document starts, please rebuild the document array with spumoni build -d.");
+    if (run_opts->use_canonical)
+        FORCE_LOG("compute_pml", "reads are digested into canonical minimizers, and queried in both orientations");
+    else if (run_opts->both_strands)
+        FORCE_LOG("compute_pml", "each read and its reverse complement are queried, and the longer match is kept at each position");
 
     // Process all the reads in the input pattern file
     auto start_time = std::chrono::system_clock::now();
@@ -1309,18 +2509,20 @@ int run_spumoni_main(SpumoniRunOptions* run_opts){
     
     size_t num_reads = 0;
     if (!run_opts->is_general_text) {
-        num_reads = classify_reads_pml(&ms, run_opts->ref_file, run_opts->pattern_file, run_opts->use_doc, 
-                                       run_opts->min_digest, run_opts->write_report, run_opts->threads,
-                                       run_opts->k, run_opts->w, run_opts->use_promotions, 
-                                       run_opts->use_dna_letters, run_opts->bin_size);
+        num_reads = classify_reads_pml(replicas, run_opts, topology, node_stats);
     } else {
-        num_reads = classify_general_reads_pml(&ms, run_opts->ref_file, run_opts->pattern_file);
+        num_reads = classify_general_reads_pml(replicas[0], run_opts->ref_file, run_opts->pattern_file);
     }
 
-    DONE_LOG((std::chrono::system_clock::now() - start_time));
+    auto elapsed = std::chrono::system_clock::now() - start_time;
+    DONE_LOG(elapsed);
     FORCE_LOG("compute_pml", "finished processing %d reads. results are saved in *.pseudo_lengths file.", num_reads);
+    if (run_opts->numa_placement != NUMA_OFF && !run_opts->is_general_text)
+        topology.print_node_throughput("compute_pml", node_stats, std::chrono::duration<double>(elapsed).count());
     std::cout << std::endl;
 
+    for (auto replica: replicas) {delete replica;}
+
     return 0;
 }
 
@@ -1329,8 +2531,11 @@ int run_spumoni_ms_main(SpumoniRunOptions* run_opts) {
     using SelSd = SelectSdvec<>;
     using DagcSd = DirectAccessibleGammaCode<SelSd>;
   
-    // Loads the MS index containing the RLEBWT, Thresholds, and RA structure
-    ms_t ms(run_opts->ref_file, run_opts->use_doc, true);
+    // Loads the MS index containing the RLEBWT, Thresholds, and RA structure, on the NUMA nodes if requested
+    check_canonical_index(run_opts->ref_file + ".msnulldb", run_opts->use_canonical);
+    NumaTopology topology;
+    std::vector<ms_t*> replicas = load_index_replicas<ms_t>(run_opts, topology, "compute_ms");
+    std::vector<NodeStats> node_stats (topology.num_nodes());
     std::string out_filename = run_opts->pattern_file;
     std::cout << std::endl;
 
@@ -1343,6 +2548,34 @@ int run_spumoni_ms_main(SpumoniRunOptions* run_opts) {
                   run_opts->k, run_opts->w);
     else
         FORCE_LOG("compute_ms", "input reads will be used directly, no minimizer digestion");
+    print_cpu_kernels("compute_ms");
+
+    // Choose the query kernel specialized for the alphabet of the reads
+    alphabet_type query_alphabet = get_query_alphabet(run_opts->is_general_text, run_opts->use_promotions);
+    for (auto replica: replicas) {replica->select_query_kernels(query_alphabet);}
+    FORCE_LOG("compute_ms", "query kernel is specialized for the %s alphabet", get_alphabet_name(query_alphabet));
+
+    if (run_opts->doc_list_length > 0 && !replicas[0]->doc_arr.has_doc_starts())
+        FATAL_ERROR("Listing documents (-l) needs the document starts, please rebuild the document array with spumoni build -d.");
+
+    // Every copy of the index gets its own Phi support, so locating stays on the local node
+    if (run_opts->locate_mems) {
+        if (replicas[0]->get_ssa_rate() > 0) {
+            FATAL_ERROR("Locating the occurrences of each MEM (-o) needs all the SA samples, please rebuild the index without -s.");}
+        STATUS_LOG("compute_ms", "building the Phi support for locating MEMs");
+        auto phi_start = std::chrono::system_clock::now();
+        size_t phi_bytes = 0;
+        for (auto replica: replicas) {phi_bytes = replica->build_locate_support();}
+        DONE_LOG((std::chrono::system_clock::now() - phi_start));
+        FORCE_LOG("compute_ms", "Phi support uses %.1f MB per copy of the index", phi_bytes/(1024.0 * 1024.0));
+    }
+    FORCE_LOG("compute_ms", "index uses the %s rlbwt and the %s thresholds data-structure", 
+              get_rlbwt_name(replicas[0]->get_rlbwt_type()).data(),
+              get_thresholds_name(replicas[0]->get_thresholds_type()).data());
+    if (run_opts->use_canonical)
+        FORCE_LOG("compute_ms", "reads are digested into canonical minimizers, and queried in both orientations");
+    else if (run_opts->both_strands)
+        FORCE_LOG("compute_ms", "each read and its reverse complement are queried, and the longer match is kept at each position");
 
     // Determine approach to parse pattern files
     auto start_time = std::chrono::system_clock::now();
@@ -1350,52 +2583,77 @@ int run_spumoni_ms_main(SpumoniRunOptions* run_opts) {
 
     size_t num_reads = 0;
     if (!run_opts->is_general_text) {
-        num_reads = classify_reads_ms(&ms, run_opts->ref_file, run_opts->pattern_file, run_opts->use_doc, 
-                                      run_opts->min_digest, run_opts->write_report, run_opts->threads,
-                                      run_opts->k, run_opts->w, run_opts->use_promotions, 
-                                      run_opts->use_dna_letters, run_opts->bin_size);
+        num_reads = classify_reads_ms(replicas, run_opts, topology, node_stats);
     } else {
-        num_reads = classify_general_reads_ms(&ms, run_opts->ref_file, run_opts->pattern_file);
+        num_reads = classify_general_reads_ms(replicas[0], run_opts->ref_file, run_opts->pattern_file);
     }
 
-    DONE_LOG((std::chrono::system_clock::now() - start_time));
-    FORCE_LOG("compute_ms", "finished processing %d reads. results are saved in *.lengths file.", num_reads);
+    auto elapsed = std::chrono::system_clock::now() - start_time;
+    DONE_LOG(elapsed);
+    FORCE_LOG("compute_ms", "finished processing %d reads. results are saved in %s file.", num_reads, 
+              (run_opts->mem_length) ? "*.mems" : "*.lengths");
+    if (run_opts->numa_placement != NUMA_OFF && !run_opts->is_general_text)
+        topology.print_node_throughput("compute_ms", node_stats, std::chrono::duration<double>(elapsed).count());
     std::cout << std::endl;
+
+    for (auto replica: replicas) {delete replica;}
     return 0;
 }
 
-std::pair<size_t, size_t> build_spumoni_ms_main(std::string ref_file) {
-    // Builds the ms_pointers objects and stores it
-    size_t length = 0, num_runs = 0;
-    ms_pointers<> ms(ref_file, true);
-    std::tie(length, num_runs) = ms.get_bwt_stats(); 
-
-    std::string outfile = ref_file + ms.get_file_extension();
-    std::ofstream out(outfile);
-    ms.serialize(out);
-    out.close();
-    return std::make_pair(length, num_runs);
+std::pair<size_t, size_t> build_spumoni_ms_main(std::string ref_file, rlbwt_type bwt_type, thresholds_type thr_type, 
+                                                size_t ssa_rate, IndexBenchmark& bench) {
+    // Builds the ms_pointers objects with the chosen RLBWT and thresholds, stores it and times its lookups
+    return dispatch_index(bwt_type, thr_type, [&](auto tag) {
+        ms_index_t<decltype(tag)> ms(ref_file, true);
+        size_t full_samples_bytes = ms.samples_size_in_bytes();
+        if (ssa_rate > 0) {ms.subsample(ssa_rate);}
+
+        std::string outfile = ref_file + ms.get_file_extension();
+        std::ofstream out(outfile);
+        size_t index_bytes = ms.serialize(out);
+        out.close();
+
+        bench = benchmark_index(ms, bwt_type, thr_type, index_bytes);
+        benchmark_samples(ms, full_samples_bytes, bench);
+        return ms.get_bwt_stats();
+    });
 }
 
-std::pair<size_t, size_t> build_spumoni_main(std::string ref_file) {
-    // Builds the pml_pointers objects and stores it
-    size_t length = 0, num_runs = 0;
-    pml_pointers<> pml(ref_file, true);
-    std::tie(length, num_runs) = pml.get_bwt_stats();
-
-    std::string outfile = ref_file + pml.get_file_extension();
-    std::ofstream out(outfile);
-    pml.serialize(out);
-    out.close();
-    return std::make_pair(length, num_runs);
+std::pair<size_t, size_t> build_spumoni_main(std::string ref_file, rlbwt_type bwt_type, thresholds_type thr_type, IndexBenchmark& bench) {
+    // Builds the pml_pointers objects with the chosen RLBWT and thresholds, stores it and times its lookups
+    return dispatch_index(bwt_type, thr_type, [&](auto tag) {
+        pml_index_t<decltype(tag)> pml(ref_file, true);
+
+        std::string outfile = ref_file + pml.get_file_extension();
+        std::ofstream out(outfile);
+        size_t index_bytes = pml.serialize(out);
+        out.close();
+
+        bench = benchmark_index(pml, bwt_type, thr_type, index_bytes);
+        return pml.get_bwt_stats();
+    });
+}
+
+void find_doc_starts(std::string ref_file, bool use_pml_index, DocumentArray& doc_arr) {
+    /* Loads one of the indexes that were built, and uses its LF to find where each document starts in the BWT */
+    if (use_pml_index) {
+        pml_t pml(ref_file, false);
+        pml.find_doc_starts(doc_arr);
+    } else {
+        ms_t ms(ref_file, false);
+        ms.find_doc_starts(doc_arr);
+    }
 }
 
 void generate_null_ms_statistics(std::string ref_file, std::string pattern_file, std::vector<size_t>& ms_stats,
-                                 bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w) {
+                                 bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w,
+                                 bool use_canonical) {
     /* Generates the null ms statistics and returns them to be saved */
 
     // Loads the index, and needed variables
     ms_t ms_index(ref_file, false);
+    ms_index.select_query_kernels(get_query_alphabet(false, use_promotions));
+    MinimizerDigester digester (k, w, use_promotions, use_canonical);
     gzFile fp = gzopen(pattern_file.data(), "r");
     kseq_t* seq = kseq_init(fp);
 
@@ -1409,14 +2667,21 @@ void generate_null_ms_statistics(std::string ref_file, std::string pattern_file,
         std::reverse(curr_read.begin(), curr_read.end());
         
         // Convert to minimizer-form if needed
-        if (use_promotions)
-            curr_read = perform_minimizer_digestion(curr_read, k, w);
-        else if (use_dna_letters)
-            curr_read = perform_dna_minimizer_digestion(curr_read, k, w);
+        if (use_promotions || use_dna_letters)
+            digester.digest(curr_read);
         
         // Generate the null MS
         std::vector<size_t> lengths, pointers;
         ms_index.matching_statistics(curr_read.c_str(), curr_read.length(), lengths, pointers);
+
+        // canonical indexes only hold one strand, so query both like spumoni run does
+        if (use_canonical) {
+            std::string rev_read;
+            std::vector<size_t> rev_lengths, rev_pointers;
+            digester.reverse_minimizers(curr_read, rev_read);
+            ms_index.matching_statistics(rev_read.c_str(), rev_read.length(), rev_lengths, rev_pointers);
+            take_reverse_strand(lengths, rev_lengths, lengths, rev_lengths);
+        }
         ms_stats.insert(ms_stats.end(), lengths.begin(), lengths.end());
     }
     kseq_destroy(seq);
@@ -1424,11 +2689,14 @@ void generate_null_ms_statistics(std::string ref_file, std::string pattern_file,
 }
 
 void generate_null_pml_statistics(std::string ref_file, std::string pattern_file, std::vector<size_t>& pml_stats,
-                                 bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w) {
+                                 bool min_digest, bool use_promotions, bool use_dna_letters, size_t k, size_t w,
+                                 bool use_canonical) {
     /* Generates the null pml statistics and returns them to be saved */
 
     // Load the indexes, and needed variables
     pml_t pml_index(ref_file, false);
+    pml_index.select_query_kernels(get_query_alphabet(false, use_promotions));
+    MinimizerDigester digester (k, w, use_promotions, use_canonical);
     gzFile fp = gzopen(pattern_file.data(), "r");
     kseq_t* seq = kseq_init(fp);
 
@@ -1442,14 +2710,21 @@ void generate_null_pml_statistics(std::string ref_file, std::string pattern_file
         std::reverse(curr_read.begin(), curr_read.end());
 
         // Convert to minimizer-form if needed
-        if (use_promotions)
-            curr_read = perform_minimizer_digestion(curr_read, k, w);
-        else if (use_dna_letters)
-            curr_read = perform_dna_minimizer_digestion(curr_read, k, w);
+        if (use_promotions || use_dna_letters)
+            digester.digest(curr_read);
 
         // Generate the null PML
         std::vector<size_t> lengths;
         pml_index.matching_statistics(curr_read.c_str(), curr_read.length(), lengths);
+
+        // canonical indexes only hold one strand, so query both like spumoni run does
+        if (use_canonical) {
+            std::string rev_read;
+            std::vector<size_t> rev_lengths;
+            digester.reverse_minimizers(curr_read, rev_read);
+            pml_index.matching_statistics(rev_read.c_str(), rev_read.length(), rev_lengths);
+            take_reverse_strand(lengths, rev_lengths, lengths, rev_lengths);
+        }
         pml_stats.insert(pml_stats.end(), lengths.begin(), lengths.end());
     }
     kseq_destroy(seq);
@@ -1518,12 +2793,15 @@ void generate_null_pml_statistics_for_general_text(std::string ref_file, std::st
 }
 
 void find_threshold_based_on_null_pml_distribution(const char* ref_file, const char* null_reads, bool use_minimizers,
-                                                   bool use_promotions, bool use_dna_letters, size_t k, size_t w, EmpNullDatabase& null_db, size_t bin_width) {
+                                                   bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool use_canonical,
+                                                   EmpNullDatabase& null_db, size_t bin_width) {
 
     /* Generates a distribution of KS-stats from null reads to determine the optimal threshold */
 
     // Load the indexes, and needed variables
     pml_t pml_index(ref_file, false);
+    pml_index.select_query_kernels(get_query_alphabet(false, use_promotions));
+    MinimizerDigester digester (k, w, use_promotions, use_canonical);
     gzFile fp = gzopen(null_reads, "r");
     kseq_t* seq = kseq_init(fp);
 
@@ -1542,14 +2820,21 @@ void find_threshold_based_on_null_pml_distribution(const char* ref_file, const c
         std::reverse(curr_read.begin(), curr_read.end());
 
         // Convert to minimizer-form if needed
-        if (use_promotions)
-            curr_read = perform_minimizer_digestion(curr_read, k, w);
-        else if (use_dna_letters)
-            curr_read = perform_dna_minimizer_digestion(curr_read, k, w);
+        if (use_promotions || use_dna_letters)
+            digester.digest(curr_read);
 
         // Generate the null PML
         std::vector<size_t> lengths;
         pml_index.matching_statistics(curr_read.c_str(), curr_read.length(), lengths);
+
+        // canonical indexes only hold one strand, so query both like spumoni run does
+        if (use_canonical) {
+            std::string rev_read;
+            std::vector<size_t> rev_lengths;
+            digester.reverse_minimizers(curr_read, rev_read);
+            pml_index.matching_statistics(rev_read.c_str(), rev_read.length(), rev_lengths);
+            take_reverse_strand(lengths, rev_lengths, lengths, rev_lengths);
+        }
         pml_stats.insert(pml_stats.end(), lengths.begin(), lengths.end());
 
         // Generate the KS-statistics
@@ -1575,12 +2860,15 @@ void find_threshold_based_on_null_pml_distribution(const char* ref_file, const c
 }
 
 void find_threshold_based_on_null_ms_distribution(const char* ref_file, const char* null_reads, bool use_minimizers,
-                                                   bool use_promotions, bool use_dna_letters, size_t k, size_t w, EmpNullDatabase& null_db, size_t bin_width) {
+                                                   bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool use_canonical,
+                                                   EmpNullDatabase& null_db, size_t bin_width) {
 
     /* Generates a distribution of KS-stats from null reads to determine the optimal threshold */
 
     // Load the indexes, and needed variables
     ms_t ms_index(ref_file, false);
+    ms_index.select_query_kernels(get_query_alphabet(false, use_promotions));
+    MinimizerDigester digester (k, w, use_promotions, use_canonical);
     gzFile fp = gzopen(null_reads, "r");
     kseq_t* seq = kseq_init(fp);
     
@@ -1600,14 +2888,21 @@ void find_threshold_based_on_null_ms_distribution(const char* ref_file, const ch
         std::reverse(curr_read.begin(), curr_read.end());
 
         // Convert to minimizer-form if needed
-        if (use_promotions)
-            curr_read = perform_minimizer_digestion(curr_read, k, w);
-        else if (use_dna_letters)
-            curr_read = perform_dna_minimizer_digestion(curr_read, k, w);
+        if (use_promotions || use_dna_letters)
+            digester.digest(curr_read);
 
         // Generate the null PML
         std::vector<size_t> lengths, pointers;
         ms_index.matching_statistics(curr_read.c_str(), curr_read.length(), lengths, pointers);
+
+        // canonical indexes only hold one strand, so query both like spumoni run does
+        if (use_canonical) {
+            std::string rev_read;
+            std::vector<size_t> rev_lengths, rev_pointers;
+            digester.reverse_minimizers(curr_read, rev_read);
+            ms_index.matching_statistics(rev_read.c_str(), rev_read.length(), rev_lengths, rev_pointers);
+            take_reverse_strand(lengths, rev_lengths, lengths, rev_lengths);
+        }
         ms_stats.insert(ms_stats.end(), lengths.begin(), lengths.end());
 
         // Generate the KS-statistics
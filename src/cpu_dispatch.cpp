@@ -0,0 +1,184 @@
+ /*
+  * File: cpu_dispatch.cpp
+  * Description: Implements the hot kernels used during querying
+  *              in multiple instruction set variants, and selects
+  *              the best variant at startup based on CPUID.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <cpu_dispatch.hpp>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SPUMONI_X86 1
+#else
+#define SPUMONI_X86 0
+#endif
+
+/*
+ * Section 1: Portable versions of the kernels, these are used
+ * when none of the instruction set extensions are available.
+ */
+
+static void to_upper_scalar(char* seq, size_t length) {
+    /* Converts ASCII lower-case letters to upper-case, and leaves everything else */
+    for (size_t i = 0; i < length; i++)
+        seq[i] = (seq[i] >= 'a' && seq[i] <= 'z') ? (seq[i] - 32) : seq[i];
+}
+
+static size_t max_value_scalar(const size_t* values, size_t length) {
+    /* Returns the maximum value in the range */
+    size_t max_val = 0;
+    for (size_t i = 0; i < length; i++)
+        max_val = std::max(max_val, values[i]);
+    return max_val;
+}
+
+/*
+ * Section 2: Versions of the kernels for specific instruction
+ * sets, only compiled when building for x86-64.
+ */
+
+#if SPUMONI_X86
+__attribute__((target("avx2")))
+static void to_upper_avx2(char* seq, size_t length) {
+    /* Converts 32 characters at a time, bytes above 127 are negative so never in range */
+    const __m256i lower_bound = _mm256_set1_epi8('a' - 1);
+    const __m256i upper_bound = _mm256_set1_epi8('z' + 1);
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(seq + i));
+        __m256i is_lower = _mm256_and_si256(_mm256_cmpgt_epi8(chars, lower_bound),
+                                            _mm256_cmpgt_epi8(upper_bound, chars));
+        chars = _mm256_sub_epi8(chars, _mm256_and_si256(is_lower, case_bit));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(seq + i), chars);
+    }
+    to_upper_scalar(seq + i, length - i);
+}
+
+__attribute__((target("avx512bw")))
+static void to_upper_avx512(char* seq, size_t length) {
+    /* Converts 64 characters at a time using mask registers */
+    const __m512i lower_bound = _mm512_set1_epi8('a');
+    const __m512i upper_bound = _mm512_set1_epi8('z');
+    const __m512i case_bit = _mm512_set1_epi8(0x20);
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64) {
+        __m512i chars = _mm512_loadu_si512(seq + i);
+        __mmask64 is_lower = _mm512_cmpge_epi8_mask(chars, lower_bound) &
+                             _mm512_cmple_epi8_mask(chars, upper_bound);
+        chars = _mm512_mask_sub_epi8(chars, is_lower, chars, case_bit);
+        _mm512_storeu_si512(seq + i, chars);
+    }
+    to_upper_scalar(seq + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t max_value_avx2(const size_t* values, size_t length) {
+    /* AVX2 only has signed 64-bit comparisons, so flip the sign bit before comparing */
+    const __m256i sign_bit = _mm256_set1_epi64x(static_cast<long long>(1ULL << 63));
+    __m256i curr_max = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i vals = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i is_greater = _mm256_cmpgt_epi64(_mm256_xor_si256(vals, sign_bit),
+                                                _mm256_xor_si256(curr_max, sign_bit));
+        curr_max = _mm256_blendv_epi8(curr_max, vals, is_greater);
+    }
+
+    size_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), curr_max);
+    size_t max_val = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+    return std::max(max_val, max_value_scalar(values + i, length - i));
+}
+
+__attribute__((target("avx512f")))
+static size_t max_value_avx512(const size_t* values, size_t length) {
+    /* Uses the native unsigned 64-bit maximum */
+    __m512i curr_max = _mm512_setzero_si512();
+
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8)
+        curr_max = _mm512_max_epu64(curr_max, _mm512_loadu_si512(values + i));
+
+    size_t max_val = _mm512_reduce_max_epu64(curr_max);
+    return std::max(max_val, max_value_scalar(values + i, length - i));
+}
+
+#endif
+
+/*
+ * Section 3: Chooses the kernels, and other methods that are
+ * not specific to an instruction set.
+ */
+
+static CpuKernels select_cpu_kernels() {
+    /* Checks the features of the cpu, and picks the fastest variant of each kernel */
+    CpuKernels kernels;
+    kernels.to_upper = to_upper_scalar;
+    kernels.max_value = max_value_scalar;
+
+#if SPUMONI_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512bw")) {
+        kernels.to_upper = to_upper_avx512; kernels.to_upper_isa = "avx512bw";
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernels.to_upper = to_upper_avx2; kernels.to_upper_isa = "avx2";
+    }
+
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels.max_value = max_value_avx512; kernels.max_value_isa = "avx512f";
+    } else if (__builtin_cpu_supports("avx2")) {
+        kernels.max_value = max_value_avx2; kernels.max_value_isa = "avx2";
+    }
+#endif
+    return kernels;
+}
+
+const CpuKernels& get_cpu_kernels() {
+    /* Returns the kernels for this cpu, they are only chosen once */
+    static const CpuKernels kernels = select_cpu_kernels();
+    return kernels;
+}
+
+void print_cpu_kernels(const char* func) {
+    /* Logs which variant of each kernel will be used */
+    const CpuKernels& kernels = get_cpu_kernels();
+    FORCE_LOG(func, "cpu kernels selected: toupper=%s, bin-max=%s",
+              kernels.to_upper_isa, kernels.max_value_isa);
+}
+
+void append_values(std::string& out, const size_t* values, size_t length) {
+    /* Writes the values as space-separated text (same as an ostream_iterator), two digits at a time */
+    static const char digit_pairs[] = "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                                      "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+                                      "8081828384858687888990919293949596979899";
+    char buffer[24];
+    for (size_t i = 0; i < length; i++) {
+        size_t curr_val = values[i];
+        char* end = buffer + sizeof(buffer);
+        char* pos = end;
+
+        while (curr_val >= 100) {
+            size_t pair = (curr_val % 100) * 2;
+            curr_val /= 100;
+            *--pos = digit_pairs[pair+1];
+            *--pos = digit_pairs[pair];
+        }
+        if (curr_val >= 10) {
+            *--pos = digit_pairs[curr_val*2+1];
+            *--pos = digit_pairs[curr_val*2];
+        } else {
+            *--pos = static_cast<char>('0' + curr_val);
+        }
+        out.append(pos, end - pos);
+        out.push_back(' ');
+    }
+}
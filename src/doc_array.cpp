@@ -13,7 +13,13 @@
 #include <algorithm>
 #include <fstream>
 #include <math.h> 
+#include <numeric>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sdsl/vectors.hpp>
+#include <unordered_map>
 
 DocumentArray::DocumentArray(std::string ref_path, size_t num_runs): ref_file(ref_path) {
     /* Constructs a document array - maps suffix array positions to genomes they occur in */
@@ -24,62 +30,112 @@ DocumentArray::DocumentArray(std::string ref_path, size_t num_runs): ref_file(re
 
     ASSERT(start_samples_size ==  end_samples_size, "The .ssa and .esa files are not equally sized as expected.");
     this->num_entries = (start_samples_size)/ (2 * SSABYTES);
-    
-    // Read through the samples ...
-    std::vector<size_t> start_samples_orig = read_samples(ref_path + ".ssa");
-    std::vector<size_t> end_samples_orig = read_samples(ref_path + ".esa");
 
     // Determine the ending positions for each interval
-    std::vector<size_t> end_pos;
     load_seq_boundaries(); // loads the seq_lengths vector
-    end_pos.resize(this->seq_lengths.size());
-
-    size_t i = 0, sum = 0;
-    std::transform(seq_lengths.begin(), seq_lengths.end(), end_pos.begin(),
-                  [&](size_t size) {if (i == 0){sum = seq_lengths[0]; i++; return sum;} 
-                                    else {sum += seq_lengths[i];
-                                          i++; return sum;}});
-    
-    size_t last_pos = end_pos.back();
-    end_pos.back() = last_pos + 1; // add 1 for dollar sign
-
-    // Convert suffix samples to the positions of BWT characters
-    auto convert_to_bwt_pos = [&] (size_t sample) {
-        if (sample > 0) {return (sample-1);}
-        else {return (end_pos.back()-1);}
-    };
-
-    std::vector<size_t> start_samples, end_samples;
-    start_samples.resize(start_samples_orig.size());
-    end_samples.resize(end_samples_orig.size());
-
-    std::transform(start_samples_orig.begin(), start_samples_orig.end(), 
-                   start_samples.begin(), convert_to_bwt_pos);
-    std::transform(end_samples_orig.begin(), end_samples_orig.end(), 
-                   end_samples.begin(), convert_to_bwt_pos);
-
-    // Perform a binary search for each value
-    std::vector<size_t> start_genome_ids, end_genome_ids;
-    start_genome_ids.resize(start_samples.size());
-    end_genome_ids.resize(end_samples.size());
-
-    std::transform(start_samples.begin(), start_samples.end(), 
-                   start_genome_ids.begin(), [&](size_t pos) {return binary_search_for_pos(end_pos, pos);});
-    std::transform(end_samples.begin(), end_samples.end(), 
-                   end_genome_ids.begin(), [&](size_t pos) {return binary_search_for_pos(end_pos, pos);});             
+    std::vector<size_t> end_pos (this->seq_lengths.size());
+    std::partial_sum(seq_lengths.begin(), seq_lengths.end(), end_pos.begin());
+    end_pos.back() += 1; // add 1 for dollar sign
 
     // Write the document array to int vectors
-    uint32_t max_width = std::ceil(std::log2((this->seq_lengths.size() + 0.0)));
+    uint32_t max_width = std::max(static_cast<int>(std::ceil(std::log2((this->seq_lengths.size() + 0.0)))), 1);
     DBG_ONLY("%s %d", "Number of bits used per document entry:", max_width);
 
     this->start_runs_doc = sdsl::int_vector<> (num_runs, 0, max_width);
     this->end_runs_doc = sdsl::int_vector<> (num_runs, 0, max_width);
 
-    size_t k = 0, j = 0;
-    std::for_each(start_genome_ids.begin(), start_genome_ids.end(), 
-                  [&](size_t genome_id){start_runs_doc[k] = genome_id; k++;});
-    std::for_each(end_genome_ids.begin(), end_genome_ids.end(), 
-                  [&](size_t genome_id){end_runs_doc[j] = genome_id; j++;});
+    // The samples are streamed from the files, and looked up straight into the int vectors
+    fill_run_docs(ref_path + ".ssa", end_pos, this->start_runs_doc);
+    fill_run_docs(ref_path + ".esa", end_pos, this->end_runs_doc);
+}
+
+void DocumentArray::fill_run_docs(std::string file_path, const std::vector<size_t>& end_pos, sdsl::int_vector<>& run_docs) {
+    /* 
+     * Maps the file of suffix array samples, and stores the document of each one. Threads
+     * work on chunks of DOC_BUILD_CHUNK samples, which start on a word of the int vector
+     * since the chunks are a multiple of 64 entries, so no two threads write the same word.
+     */
+    size_t length_bytes = grab_file_size(file_path);
+    size_t num_samples = std::min(length_bytes / (2 * SSABYTES), run_docs.size());
+    if (num_samples == 0) return;
+
+    int fd = open(file_path.data(), O_RDONLY);
+    if (fd < 0) {FATAL_ERROR("A path to the suffix array samples is not valid.");}
+    void* mapped = mmap(nullptr, length_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {FATAL_ERROR("Unable to map the suffix array samples in %s", file_path.data());}
+    madvise(mapped, length_bytes, MADV_SEQUENTIAL);
+    const uint8_t* samples = static_cast<const uint8_t*>(mapped);
+
+    const size_t text_end = end_pos.back();
+    const size_t num_chunks = (num_samples + DOC_BUILD_CHUNK - 1) / DOC_BUILD_CHUNK;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t chunk = 0; chunk < num_chunks; chunk++) {
+        size_t chunk_end = std::min((chunk + 1) * DOC_BUILD_CHUNK, num_samples);
+        for (size_t i = chunk * DOC_BUILD_CHUNK; i < chunk_end; i++) {
+            // each sample is a pair of 5-byte integers, the second one is the suffix array position
+            uint64_t sample = 0;
+            std::memcpy(&sample, samples + (2 * i + 1) * SSABYTES, SSABYTES);
+
+            // convert the suffix sample to the position of its BWT character
+            size_t pos = (sample > 0) ? (sample - 1) : (text_end - 1);
+            run_docs[i] = binary_search_for_pos(end_pos, pos);
+        }
+    }
+    munmap(mapped, length_bytes);
+}
+
+void DocumentArray::find_doc_starts(const std::function<size_t(size_t)>& LF) {
+    /* 
+     * Finds the BWT row of the first character of each document. Each LF step moves
+     * one character back in the text, so it starts from the closest run boundary
+     * sample at or after the document start and steps back to it.
+     */
+    std::vector<std::pair<size_t, size_t>> samples = read_sample_rows();
+    std::vector<std::pair<size_t, size_t>> starts; // row and document
+    starts.reserve(seq_lengths.size());
+
+    size_t doc_start = 0;
+    for (size_t doc = 0; doc < seq_lengths.size(); doc++) {
+        auto sample = std::lower_bound(samples.begin(), samples.end(), std::make_pair(doc_start, size_t(0)));
+        ASSERT((sample != samples.end()), "no suffix array sample found after a document start.");
+
+        size_t row = sample->second;
+        for (size_t pos = sample->first; pos > doc_start; pos--) {row = LF(row);}
+        starts.push_back({row, doc});
+        doc_start += seq_lengths[doc];
+    }
+    std::sort(starts.begin(), starts.end());
+
+    uint8_t row_width = sdsl::bits::hi(std::max<size_t>(starts.back().first, 1)) + 1;
+    uint8_t doc_width = sdsl::bits::hi(std::max<size_t>(seq_lengths.size() - 1, 1)) + 1;
+    doc_start_rows = sdsl::int_vector<>(starts.size(), 0, row_width);
+    doc_start_ids = sdsl::int_vector<>(starts.size(), 0, doc_width);
+    for (size_t i = 0; i < starts.size(); i++) {
+        doc_start_rows[i] = starts[i].first;
+        doc_start_ids[i] = starts[i].second;
+    }
+}
+
+std::vector<std::pair<size_t, size_t>> DocumentArray::read_sample_rows() const {
+    /* Reads the samples at both ends of the runs, as the text position of their BWT character and their row, sorted by position */
+    std::vector<size_t> end_pos (this->seq_lengths.size());
+    std::partial_sum(seq_lengths.begin(), seq_lengths.end(), end_pos.begin());
+    const size_t text_end = end_pos.back() + 1;
+
+    std::vector<std::pair<size_t, size_t>> samples;
+    for (std::string file_path: {ref_file + ".ssa", ref_file + ".esa"}) {
+        std::ifstream sample_file(file_path, std::ifstream::binary);
+        if (!sample_file) {FATAL_ERROR("A path to the suffix array samples is not valid.");}
+
+        // each sample is a pair of 5-byte integers, the BWT row and the suffix array position
+        uint64_t row = 0, sample = 0;
+        while (sample_file.read((char *)&row, SSABYTES) && sample_file.read((char *)&sample, SSABYTES))
+            samples.push_back({(sample > 0) ? (sample - 1) : (text_end - 1), row});
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples;
 }
 
 void DocumentArray::load_seq_boundaries() {
@@ -90,6 +146,7 @@ void DocumentArray::load_seq_boundaries() {
 
     std::ifstream index_file (ref_file + ".fdi", std::ifstream::in);
     std::string line;
+    std::vector<std::vector<std::string>> doc_labels;
 
     while(std::getline(index_file, line)) {
         auto word_list = split(line, '\t');
@@ -98,6 +155,48 @@ void DocumentArray::load_seq_boundaries() {
         bool is_num = std::all_of(seq_length.begin(), seq_length.end(), [](char c){return std::isdigit(c);});
         ASSERT(is_num, "Issue with FASTA index, sequence length is not a number.");
         this->seq_lengths.push_back(std::atol(seq_length.data()));
+        doc_labels.emplace_back(word_list.begin() + 2, word_list.end());
+    }
+    build_hierarchy(doc_labels);
+}
+
+void DocumentArray::build_hierarchy(const std::vector<std::vector<std::string>>& doc_labels) {
+    /* 
+     * Numbers the labels of each level in order of appearance, and stores the parent of
+     * each label one level up. The labels of a document go from the finest level to the
+     * coarsest, and each label can only have one parent.
+     */
+    parent_ids.clear(); level_labels.clear();
+    if (doc_labels.empty() || doc_labels[0].empty()) return;
+    size_t num_upper_levels = doc_labels[0].size();
+
+    std::vector<size_t> curr_ids (doc_labels.size());
+    std::iota(curr_ids.begin(), curr_ids.end(), 0);
+    size_t num_curr_ids = doc_labels.size();
+
+    for (size_t level = 1; level <= num_upper_levels; level++) {
+        std::unordered_map<std::string, size_t> label_ids;
+        std::vector<std::string> names;
+        std::vector<size_t> parents (num_curr_ids, SIZE_MAX);
+
+        for (size_t doc = 0; doc < doc_labels.size(); doc++) {
+            ASSERT((doc_labels[doc].size() == num_upper_levels), "Issue with FASTA index, documents have different numbers of labels.");
+            const std::string& name = doc_labels[doc][level-1];
+            auto found = label_ids.emplace(name, names.size());
+            if (found.second) {names.push_back(name);}
+
+            size_t& curr_parent = parents[curr_ids[doc]];
+            if (curr_parent != SIZE_MAX && curr_parent != found.first->second)
+                FATAL_ERROR("The label of document %ld at level %ld has more than one parent label (%s and %s).", doc, level-1,
+                            names[curr_parent].data(), name.data());
+            curr_parent = found.first->second;
+            curr_ids[doc] = found.first->second;
+        }
+
+        parent_ids.emplace_back(num_curr_ids, 0, std::max(static_cast<int>(std::ceil(std::log2(names.size() + 0.0))), 1));
+        for (size_t i = 0; i < num_curr_ids; i++) {parent_ids.back()[i] = parents[i];}
+        level_labels.push_back(std::move(names));
+        num_curr_ids = level_labels.back().size();
     }
 }
 
@@ -121,39 +220,54 @@ void DocumentArray::print_statistics() {
     }
 }
 
-std::vector<size_t> DocumentArray::read_samples(std::string file_path) {
-    /* Reads in the suffix array samples from the provided file */
-    std::ifstream samples_file (file_path, std::ifstream::binary);
-    std::vector<size_t> samples;
+size_t DocumentArray::binary_search_for_pos(const std::vector<size_t>& end_pos, size_t sample_pos) {
+    /* Performs a binary search to determine what genome a certain offset occurs in */
+    // The positions are non-inclusive, so it is the first sequence that ends after the offset
+    size_t true_pos = std::upper_bound(end_pos.begin(), end_pos.end(), sample_pos) - end_pos.begin();
+    ASSERT((true_pos < end_pos.size()), "binary search during document array building has an issue.");
+    return true_pos;
+}
 
-    uint64_t left = 0, right = 0;
-    size_t pos = 0;
+void DocumentArray::run_length_encode() {
+    /* Switches to the run-length encoded form, which only keeps the documents where they change */
+    encode_runs(this->start_runs_doc, this->start_doc_heads, this->start_doc_values);
+    encode_runs(this->end_runs_doc, this->end_doc_heads, this->end_doc_values);
 
-    while (samples_file.read((char*) &left, SSABYTES) && samples_file.read((char*) &right, SSABYTES)) {
-        samples.push_back(right);
-    }
-    samples_file.close();
-    return samples;
+    this->start_runs_doc = sdsl::int_vector<>();
+    this->end_runs_doc = sdsl::int_vector<>();
+    this->start_doc_rank = sdsl::sd_vector<>::rank_1_type(&this->start_doc_heads);
+    this->end_doc_rank = sdsl::sd_vector<>::rank_1_type(&this->end_doc_heads);
+    this->run_length = true;
 }
 
-size_t DocumentArray::binary_search_for_pos(std::vector<size_t> end_pos, size_t sample_pos) {
-    /* Performs a binary search to determine what genome a certain offset occurs in */
-    size_t low = 0, mid = 0, high = end_pos.size() - 1;
-    size_t true_pos = 0;
-
-    while (low < high) {
-        mid = (low + high)/2;
-        if (end_pos[mid] == sample_pos) {true_pos = mid+1; break;} // The positions are non-inclusive, that explains +1
-        else if (sample_pos < end_pos[mid]){high = mid;}
-        else {low = mid + 1;}
+void DocumentArray::encode_runs(const sdsl::int_vector<>& run_docs, sdsl::sd_vector<>& heads, sdsl::int_vector<>& values) {
+    /* Marks each run whose document differs from the previous run, and keeps the document of the marked runs */
+    sdsl::bit_vector changes(run_docs.size(), 0);
+    size_t num_changes = 0;
+    for (size_t i = 0; i < run_docs.size(); i++) {
+        if (i == 0 || run_docs[i] != run_docs[i-1]) {changes[i] = 1; num_changes++;}
     }
-    if (low >= high) {true_pos = high;} // only applies update when binary search was exhausted
-    if (sample_pos >= end_pos[true_pos]) {true_pos++;} // Make adjustment since these positions are not inclusive
+    heads = sdsl::sd_vector<>(changes);
 
-    std::string assert_msg = "binary search during document array building has an issue.";
-    if (true_pos > 0) { ASSERT((sample_pos < end_pos[true_pos] && sample_pos >= end_pos[true_pos-1]), assert_msg.data());}
-    else {ASSERT((sample_pos < end_pos[true_pos]), assert_msg.data());}
-    return true_pos;
+    values = sdsl::int_vector<>(num_changes, 0, run_docs.width());
+    for (size_t i = 0, j = 0; i < run_docs.size(); i++) {
+        if (changes[i]) {values[j++] = run_docs[i];}
+    }
+}
+
+size_t DocumentArray::size_in_bytes() const {
+    /* Returns the memory used by the document array in its current form */
+    size_t extra_bytes = sdsl::size_in_bytes(doc_start_rows) + sdsl::size_in_bytes(doc_start_ids);
+    for (auto& parents: parent_ids) {extra_bytes += sdsl::size_in_bytes(parents);}
+
+    if (!run_length) {return sdsl::size_in_bytes(start_runs_doc) + sdsl::size_in_bytes(end_runs_doc) + extra_bytes;}
+    return sdsl::size_in_bytes(start_doc_heads) + sdsl::size_in_bytes(end_doc_heads) +
+           sdsl::size_in_bytes(start_doc_values) + sdsl::size_in_bytes(end_doc_values) + extra_bytes;
+}
+
+std::string DocumentArray::get_file_extension(std::string ref_file) {
+    /* Returns the extension of the document array that was built for this reference, run-length encoded first */
+    return (is_file(ref_file + ".rldoc")) ? ".rldoc" : ".doc";
 }
 
 size_t DocumentArray::serialize(std::ostream &out, sdsl::structure_tree_node *v, std::string name) {
@@ -163,14 +277,80 @@ size_t DocumentArray::serialize(std::ostream &out, sdsl::structure_tree_node *v,
     out.write((char *)&this->num_entries, sizeof(this->num_entries));
     written_bytes += sizeof(this->num_entries);
 
-    written_bytes += this->start_runs_doc.serialize(out, child, "start_doc");
-    written_bytes += this->end_runs_doc.serialize(out, child, "end_doc");
+    if (run_length) {
+        written_bytes += this->start_doc_heads.serialize(out, child, "start_doc_heads");
+        written_bytes += this->end_doc_heads.serialize(out, child, "end_doc_heads");
+        written_bytes += this->start_doc_values.serialize(out, child, "start_doc_values");
+        written_bytes += this->end_doc_values.serialize(out, child, "end_doc_values");
+    } else {
+        written_bytes += this->start_runs_doc.serialize(out, child, "start_doc");
+        written_bytes += this->end_runs_doc.serialize(out, child, "end_doc");
+    }
+
+    // the label hierarchy goes last, so document arrays without one still load
+    size_t num_upper_levels = parent_ids.size();
+    out.write((char *)&num_upper_levels, sizeof(num_upper_levels));
+    written_bytes += sizeof(num_upper_levels);
+    for (size_t level = 0; level < num_upper_levels; level++) {
+        written_bytes += parent_ids[level].serialize(out, child, "parent_ids");
+
+        size_t num_labels = level_labels[level].size();
+        out.write((char *)&num_labels, sizeof(num_labels));
+        written_bytes += sizeof(num_labels);
+        for (auto& name: level_labels[level]) {
+            size_t name_length = name.length();
+            out.write((char *)&name_length, sizeof(name_length));
+            out.write(name.data(), name_length);
+            written_bytes += sizeof(name_length) + name_length;
+        }
+    }
+
+    // the document starts follow, they were added after the hierarchy
+    written_bytes += doc_start_rows.serialize(out, child, "doc_start_rows");
+    written_bytes += doc_start_ids.serialize(out, child, "doc_start_ids");
     sdsl::structure_tree::add_size(child, written_bytes);
     return written_bytes;
 }
 
-void DocumentArray::load(std::istream& in) {
+void DocumentArray::load(std::istream& in, bool use_run_length) {
+    /* Loads a serialized document array, the run-length encoded form is stored in the .rldoc file */
     in.read((char *)&this->num_entries, sizeof(this->num_entries));
-    start_runs_doc.load(in);
-    end_runs_doc.load(in);
+    this->run_length = use_run_length;
+    if (use_run_length) {
+        start_doc_heads.load(in);
+        end_doc_heads.load(in);
+        start_doc_values.load(in);
+        end_doc_values.load(in);
+        start_doc_rank = sdsl::sd_vector<>::rank_1_type(&start_doc_heads);
+        end_doc_rank = sdsl::sd_vector<>::rank_1_type(&end_doc_heads);
+    } else {
+        start_runs_doc.load(in);
+        end_runs_doc.load(in);
+    }
+
+    size_t num_upper_levels = 0;
+    parent_ids.clear(); level_labels.clear();
+    doc_start_rows = sdsl::int_vector<>(); doc_start_ids = sdsl::int_vector<>();
+    if (in.peek() == EOF) return; // built before document arrays had a label hierarchy
+    in.read((char *)&num_upper_levels, sizeof(num_upper_levels));
+
+    parent_ids.resize(num_upper_levels);
+    level_labels.resize(num_upper_levels);
+    for (size_t level = 0; level < num_upper_levels; level++) {
+        parent_ids[level].load(in);
+
+        size_t num_labels = 0;
+        in.read((char *)&num_labels, sizeof(num_labels));
+        level_labels[level].resize(num_labels);
+        for (auto& name: level_labels[level]) {
+            size_t name_length = 0;
+            in.read((char *)&name_length, sizeof(name_length));
+            name.resize(name_length);
+            in.read(&name[0], name_length);
+        }
+    }
+
+    if (in.peek() == EOF) return; // built before the document starts were stored
+    doc_start_rows.load(in);
+    doc_start_ids.load(in);
 }
@@ -0,0 +1,130 @@
+ /*
+  * File: doc_vote.cpp
+  * Description: Implements the per-read document vote, and the table
+  *              of label abundances over all the reads.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <doc_vote.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <cstdio>
+
+DocumentVoter::DocumentVoter(vote_rule rule, const DocumentArray* doc_arr): rule(rule), doc_arr(doc_arr) {
+    /* Sets up the tables for the documents, and for each level of labels above them */
+    size_t num_levels = (doc_arr != nullptr) ? doc_arr->num_levels() : 1;
+    winners.resize(num_levels);
+    label_reads.resize(num_levels);
+    num_unassigned.assign(num_levels, 0);
+}
+
+void DocumentVoter::vote(const std::vector<size_t>& lengths, const std::vector<size_t>& doc_nums) {
+    /* Weights the document of each position by its length, and assigns the read using the tie rule */
+    for (auto& level_winners: winners) {level_winners.clear();}
+    std::vector<size_t>& docs = winners[0];
+    best_score = 0; total_score = 0;
+
+    size_t num_positions = std::min(lengths.size(), doc_nums.size());
+    for (size_t i = 0; i < num_positions; i++) {
+        if (lengths[i] == 0) continue;
+        size_t doc = doc_nums[i];
+        if (doc >= scores.size()) {scores.resize(doc + 1, 0);}
+        if (scores[doc] == 0) {voted_docs.push_back(doc);}
+        scores[doc] += lengths[i];
+        total_score += lengths[i];
+    }
+
+    for (size_t doc: voted_docs) {best_score = std::max(best_score, scores[doc]);}
+    for (size_t doc: voted_docs) {
+        if (best_score > 0 && scores[doc] == best_score) {docs.push_back(doc);}
+        scores[doc] = 0;
+    }
+    voted_docs.clear();
+    std::sort(docs.begin(), docs.end());
+
+    // a tie is either split between the documents, left unassigned, or given to the lowest one
+    if (docs.size() > 1) {
+        if (rule == VOTE_UNIQUE) {docs.clear();}
+        else if (rule == VOTE_LOWEST) {docs.resize(1);}
+    }
+    assign_upper_levels();
+
+    num_reads++;
+    for (size_t level = 0; level < winners.size(); level++) {
+        if (winners[level].empty()) {num_unassigned[level]++; continue;}
+        std::vector<double>& reads = label_reads[level];
+        if (winners[level].back() >= reads.size()) {reads.resize(winners[level].back() + 1, 0.0);}
+        for (size_t label: winners[level]) {reads[label] += 1.0 / winners[level].size();}
+    }
+}
+
+void DocumentVoter::assign_upper_levels() {
+    /*
+     * Assigns each level above the documents to the parents of the labels one level below. With
+     * the lca rule, only the levels where the tied documents share one label are kept, so the read
+     * is assigned to their lowest common ancestor and the levels above it.
+     */
+    for (size_t level = 1; level < winners.size(); level++) {
+        std::vector<size_t>& labels = winners[level];
+        for (size_t child: winners[level-1]) {labels.push_back(doc_arr->parent(child, level-1));}
+        std::sort(labels.begin(), labels.end());
+        labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+    }
+    if (rule != VOTE_LCA) return;
+    for (auto& labels: winners) {
+        if (labels.size() > 1) {labels.clear();}
+    }
+}
+
+void DocumentVoter::append_assignment(std::string& text) const {
+    /*
+     * Writes the documents of the last read (* if unassigned), its score, the share of votes it
+     * got, and then the names of its labels at each level above the documents.
+     */
+    char buf[64];
+    auto append_labels = [&](size_t level) {
+        if (winners[level].empty()) {text.push_back('*');}
+        for (size_t i = 0; i < winners[level].size(); i++) {
+            if (i) {text.push_back(',');}
+            if (level == 0) {text.append(std::to_string(winners[level][i]));}
+            else {text.append(doc_arr->label_name(winners[level][i], level));}
+        }
+    };
+    append_labels(0);
+    int len = std::snprintf(buf, sizeof(buf), "\t%zu\t%.3f", best_score,
+                            (total_score) ? (best_score + 0.0) / total_score : 0.0);
+    text.append(buf, len);
+    for (size_t level = 1; level < winners.size(); level++) {
+        text.push_back('\t');
+        append_labels(level);
+    }
+}
+
+void DocumentVoter::merge(const DocumentVoter& other) {
+    /* Adds the counts of another thread's voter to this one */
+    for (size_t level = 0; level < label_reads.size(); level++) {
+        std::vector<double>& reads = label_reads[level];
+        const std::vector<double>& other_reads = other.label_reads[level];
+        if (other_reads.size() > reads.size()) {reads.resize(other_reads.size(), 0.0);}
+        for (size_t label = 0; label < other_reads.size(); label++) {reads[label] += other_reads[label];}
+        num_unassigned[level] += other.num_unassigned[level];
+    }
+    num_reads += other.num_reads;
+}
+
+void DocumentVoter::write_abundance(std::ostream& out) const {
+    /* Writes the number and fraction of reads assigned to each label of each level, followed by the unassigned reads */
+    out << std::fixed << std::setprecision(4);
+    out << "level\tlabel\treads\tfraction\n";
+    for (size_t level = 0; level < label_reads.size(); level++) {
+        for (size_t label = 0; label < label_reads[level].size(); label++) {
+            double reads = label_reads[level][label];
+            if (reads == 0.0) continue;
+            out << level << '\t' << ((level) ? doc_arr->label_name(label, level) : std::to_string(label)) << '\t'
+                << reads << '\t' << ((num_reads) ? reads / num_reads : 0.0) << '\n';
+        }
+        out << level << "\tunassigned\t" << (num_unassigned[level] + 0.0) << '\t'
+            << ((num_reads) ? (num_unassigned[level] + 0.0) / num_reads : 0.0) << '\n';
+    }
+}
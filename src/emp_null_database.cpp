@@ -17,20 +17,22 @@
 #include <sdsl/vectors.hpp>
 
 EmpNullDatabase::EmpNullDatabase(const char* ref_file, const char* null_reads, bool use_minimizers, output_type index_type, 
-                                bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool is_general_text) {
+                                bool use_promotions, bool use_dna_letters, size_t k, size_t w, bool use_canonical,
+                                bool is_general_text) {
     /* Builds the null database of MS/PML and saves it */
     this->input_file = std::string(ref_file);
     this->stat_type = index_type;
+    this->use_canonical = use_canonical;
 
     // Generate those null statistics depending on the index type and input type
     std::vector<size_t> output_stats;
     if (!is_general_text) { // for FASTA input
         if (stat_type == MS)
             generate_null_ms_statistics(this->input_file, std::string(null_reads), output_stats, use_minimizers, 
-                                        use_promotions, use_dna_letters, k, w);
+                                        use_promotions, use_dna_letters, k, w, use_canonical);
         else if (stat_type == PML)
             generate_null_pml_statistics(this->input_file, std::string(null_reads), output_stats, use_minimizers, 
-                                        use_promotions, use_dna_letters, k, w);
+                                        use_promotions, use_dna_letters, k, w, use_canonical);
     } else { // for general text input
         if (stat_type == MS)
             generate_null_ms_statistics_for_general_text(this->input_file, std::string(null_reads), output_stats);
@@ -97,6 +99,11 @@ size_t EmpNullDatabase::serialize(std::ostream &out, sdsl::structure_tree_node *
     written_bytes += sizeof(this->percentile_value);
 
     written_bytes += this->null_stats.serialize(out, child, "null_stats");
+
+    // stored last, so databases built before canonical minimizers still load
+    uint8_t canonical_flag = this->use_canonical;
+    out.write((char *)&canonical_flag, sizeof(canonical_flag));
+    written_bytes += sizeof(canonical_flag);
     sdsl::structure_tree::add_size(child, written_bytes);
     return written_bytes;
 }
@@ -109,6 +116,11 @@ void EmpNullDatabase::load(std::istream& in) {
     in.read((char *)&this->percentile_value, sizeof(this->percentile_value));
     null_stats.load(in);
 
+    // older databases do not have the flag, and they could only be built without -C
+    uint8_t canonical_flag = 0;
+    if (in.peek() != EOF) {in.read((char *)&canonical_flag, sizeof(canonical_flag));}
+    this->use_canonical = canonical_flag;
+
     /*
     // Old code that has been moved to constructor
     double sum_values = 0.0;
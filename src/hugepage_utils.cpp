@@ -0,0 +1,210 @@
+ /*
+  * File: hugepage_utils.cpp
+  * Description: Allocator that places the large arrays of the index
+  *              on 2 MB pages in order to reduce the TLB misses
+  *              during the random accesses of a query.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <hugepage_utils.hpp>
+#include <numa_utils.hpp>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <malloc.h>
+#include <sys/mman.h>
+
+// allocator of glibc, which is used for everything outside of a scope
+extern "C" {
+    void* __libc_malloc(size_t size) noexcept;
+    void* __libc_calloc(size_t num, size_t size) noexcept;
+    void* __libc_realloc(void* ptr, size_t size) noexcept;
+    void __libc_free(void* ptr) noexcept;
+}
+
+struct SlotHeader {
+    size_t slot_bytes = 0; // length of the mapping, including this header
+    size_t size = 0; // number of bytes requested
+    bool reserved = false; // backed by reserved huge pages
+};
+
+// header is padded to a cache line, so the data has the same alignment as the slot
+static constexpr size_t SLOT_HEADER_BYTES = 64;
+static_assert(sizeof(SlotHeader) <= SLOT_HEADER_BYTES, "slot header does not fit in its padding");
+
+static std::once_flag arena_flag;
+static std::atomic<uintptr_t> arena_start {0};
+static uintptr_t arena_end = 0;
+static std::atomic<uintptr_t> arena_top {0};
+static std::atomic<size_t> reserved_total {0};
+static std::atomic<size_t> advised_total {0};
+static thread_local int scope_node = HUGEPAGE_SCOPE_OFF;
+
+static void reserve_arena() {
+    /* Sets aside an address range for the slots, it is not backed by any memory until a slot is used */
+    void* range = mmap(nullptr, HUGEPAGE_ARENA_SIZE + HUGEPAGE_SIZE, PROT_NONE, 
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (range == MAP_FAILED) return;
+
+    uintptr_t start = (reinterpret_cast<uintptr_t>(range) + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+    arena_end = start + HUGEPAGE_ARENA_SIZE;
+    arena_top.store(start);
+    arena_start.store(start, std::memory_order_release);
+}
+
+static inline bool in_arena(const void* ptr) {
+    /* Checks if the pointer was returned by a slot, which is the only way it can be inside the range */
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+    uintptr_t start = arena_start.load(std::memory_order_acquire);
+    return start && addr >= start && addr < arena_end;
+}
+
+static bool map_reserved_hugepages(void* slot, size_t length, int node_id) {
+    /* Maps reserved huge pages elsewhere first and moves them onto the slot, so the range is never left unmapped */
+    void* pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (pages == MAP_FAILED) return false; // no reserved pages left
+
+    // nothing has been touched yet, so the pages are taken from the node once they are faulted in
+    if (node_id >= 0) {NumaTopology::prefer_node_for_range(pages, length, node_id);}
+    if (mremap(pages, length, length, MREMAP_MAYMOVE | MREMAP_FIXED, slot) == MAP_FAILED) {
+        munmap(pages, length);
+        return false;
+    }
+    return true;
+}
+
+static void* slot_alloc(size_t size, int node_id) {
+    /* Takes the next slot of the range and backs it with huge pages, returns nullptr when the range is used up */
+    size_t slot_bytes = (size + SLOT_HEADER_BYTES + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+    uintptr_t start = arena_top.fetch_add(slot_bytes);
+    if (start + slot_bytes > arena_end) return nullptr;
+    void* slot = reinterpret_cast<void*>(start);
+
+    bool reserved = map_reserved_hugepages(slot, slot_bytes, node_id);
+    if (!reserved) {
+        if (mprotect(slot, slot_bytes, PROT_READ | PROT_WRITE) != 0) return nullptr;
+        if (node_id >= 0) {NumaTopology::prefer_node_for_range(slot, slot_bytes, node_id);}
+        madvise(slot, slot_bytes, MADV_HUGEPAGE);
+    }
+    madvise(slot, slot_bytes, MADV_DONTFORK);
+    (reserved ? reserved_total : advised_total).fetch_add(slot_bytes);
+
+    // fresh pages are zeroed by the kernel, so calloc does not need to clear them
+    SlotHeader* header = new (slot) SlotHeader();
+    header->slot_bytes = slot_bytes;
+    header->size = size;
+    header->reserved = reserved;
+    return static_cast<char*>(slot) + SLOT_HEADER_BYTES;
+}
+
+static void slot_free(void* ptr) {
+    /* Gives the pages of the slot back, and leaves its addresses set aside since slots are never reused */
+    void* slot = static_cast<char*>(ptr) - SLOT_HEADER_BYTES;
+    SlotHeader header = *static_cast<SlotHeader*>(slot);
+    (header.reserved ? reserved_total : advised_total).fetch_sub(header.slot_bytes);
+
+    // mapping over the slot replaces its pages in one step, so no other mapping can take the range
+    mmap(slot, header.slot_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+}
+
+static inline bool use_slot(size_t size) {
+    /* Only large allocations made by a thread inside of a scope get a slot */
+    return scope_node != HUGEPAGE_SCOPE_OFF && size >= HUGEPAGE_MIN_ALLOC && arena_start.load(std::memory_order_relaxed);
+}
+
+extern "C" void* malloc(size_t size) noexcept {
+    /* Replaces malloc of glibc, large allocations inside of a scope get a slot */
+    void* ptr = use_slot(size) ? slot_alloc(size, scope_node) : nullptr;
+    return (ptr) ? ptr : __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t num, size_t size) noexcept {
+    /* Replaces calloc of glibc, large allocations inside of a scope get a slot */
+    size_t total = 0;
+    if (__builtin_mul_overflow(num, size, &total)) return nullptr;
+    void* ptr = use_slot(total) ? slot_alloc(total, scope_node) : nullptr;
+    return (ptr) ? ptr : __libc_calloc(num, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) noexcept {
+    /* Replaces realloc of glibc, and moves arrays between slots and malloc when needed */
+    if (!in_arena(ptr)) {
+        // a growing array is moved into a slot, instead of being grown by malloc
+        if (!use_slot(size)) return __libc_realloc(ptr, size);
+        void* new_ptr = slot_alloc(size, scope_node);
+        if (!new_ptr) return __libc_realloc(ptr, size);
+        if (ptr) {
+            std::memcpy(new_ptr, ptr, std::min(size, malloc_usable_size(ptr)));
+            __libc_free(ptr);
+        }
+        return new_ptr;
+    }
+    if (size == 0) {slot_free(ptr); return nullptr;}
+
+    // same as malloc, followed by a copy of what fits
+    size_t old_size = reinterpret_cast<SlotHeader*>(static_cast<char*>(ptr) - SLOT_HEADER_BYTES)->size;
+    void* new_ptr = malloc(size);
+    if (!new_ptr) return nullptr;
+    std::memcpy(new_ptr, ptr, std::min(size, old_size));
+    slot_free(ptr);
+    return new_ptr;
+}
+
+extern "C" void free(void* ptr) noexcept {
+    /* Replaces free of glibc, and gives back the pages of slots */
+    if (in_arena(ptr)) slot_free(ptr);
+    else __libc_free(ptr);
+}
+
+HugePageScope::HugePageScope(int node_id) {
+    /* Sends the large allocations of this thread to huge pages (on the given node) until the scope ends */
+    std::call_once(arena_flag, reserve_arena);
+    prev_node = scope_node;
+    scope_node = node_id;
+}
+
+HugePageScope::~HugePageScope() {
+    /* Goes back to malloc for the allocations of this thread, the slots already handed out are kept */
+    scope_node = prev_node;
+}
+
+HugePageStats get_hugepage_stats() {
+    /* Returns the amount of memory currently held in slots, split by the kind of pages */
+    HugePageStats stats;
+    stats.reserved_bytes = reserved_total.load();
+    stats.advised_bytes = advised_total.load();
+    return stats;
+}
+
+size_t get_anon_hugepage_bytes() {
+    /* Returns the amount of memory in this process currently backed by transparent huge pages */
+    std::ifstream smaps_file ("/proc/self/smaps_rollup");
+    std::string line = "";
+
+    while (std::getline(smaps_file, line)) {
+        if (line.rfind("AnonHugePages:", 0) == 0) {
+            std::istringstream fields (line.substr(14));
+            size_t num_kb = 0;
+            fields >> num_kb;
+            return num_kb * 1024;
+        }
+    }
+    return 0;
+}
+
+std::string get_thp_mode() {
+    /* Returns the system setting for transparent huge pages (always, madvise or never) */
+    std::ifstream thp_file ("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string line = "";
+    if (!std::getline(thp_file, line)) return "unavailable";
+
+    // current setting is the one in brackets, e.g. "always [madvise] never"
+    size_t start = line.find('['), end = line.find(']');
+    if (start == std::string::npos || end == std::string::npos) return line;
+    return line.substr(start+1, end-start-1);
+}
@@ -0,0 +1,103 @@
+ /*
+  * File: minimizer_digest.cpp
+  * Description: Digests sequences into minimizers using either
+  *              alphabet promotion or DNA letters. The hashing and
+  *              window minimum are done by bonsai, so the minimizers
+  *              are the same as the ones used to build existing indexes.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <minimizer_digest.hpp>
+#include <cassert>
+
+MinimizerDigester::MinimizerDigester(size_t k, size_t w, bool use_promotions, bool use_canonical):
+                                     k(k), w(w), use_promotions(use_promotions), use_canonical(use_canonical),
+                                     sp(k, w, sp_vec), enc(sp, use_canonical), rh(k, use_canonical, bns::DNA, w) {
+    /* Builds the hasher/encoder once, and caches the DNA letters of each minimizer value */
+    // bonsai's Spacer, Encoder and RollingHasher all take w as the window length in bases,
+    // so each window holds w-k+1 k-mers and its minimizer only depends on those w bases
+    assert(w >= k);
+    window_span = w;
+
+    if (!use_promotions && k <= 8) { // at most 65,536 values
+        size_t num_kmers = 1ULL << (2 * k);
+        kmer_strings.reserve(num_kmers);
+        for (size_t x = 0; x < num_kmers; x++)
+            kmer_strings.push_back(sp.to_string(x));
+    }
+}
+
+size_t MinimizerDigester::digest(const char* seq, size_t length, std::string& output) {
+    /* Writes the minimizers of the sequence into output (with homopolymers compressed), and returns its length */
+    piece_ends ends;
+    return digest_piece(seq, length, output, ends);
+}
+
+size_t MinimizerDigester::digest_piece(const char* seq, size_t length, std::string& output, piece_ends& ends) {
+    /* Same as digest(), but also records the minimizers at both ends so pieces can be joined */
+    output.clear();
+    output.reserve(length);
+
+    // consecutive equal minimizers are only written once
+    bool is_first = true;
+    uint8_t prev_value = 0;
+
+    auto add_promoted = [&](auto x) {
+        if (is_first || prev_value != x) {
+            if (is_first) {ends.first_value = static_cast<uint8_t>(x);}
+            is_first = false;
+            prev_value = x;
+            ends.last_start = output.length();
+            output.push_back((x > 2) ? x : (x + 3)); // Reserves 0,1,2 for PFP
+        }
+    };
+
+    if (use_promotions && use_canonical) {
+        rh.for_each_canon(add_promoted, seq, length);
+    } else if (use_promotions) {
+        rh.for_each_uncanon(add_promoted, seq, length);
+    } else {
+        enc.for_each([&](auto x) {
+            if (is_first || prev_value != x) {
+                if (is_first) {ends.first_value = static_cast<uint8_t>(x);}
+                is_first = false;
+                prev_value = x;
+                ends.last_start = output.length();
+                if (x < kmer_strings.size()) output.append(kmer_strings[x]);
+                else output.append(sp.to_string(x));
+            }
+        }, seq, length);
+    }
+    if (!is_first) {ends.last_value = prev_value;}
+    return output.length();
+}
+
+void MinimizerDigester::reverse_minimizers(const std::string& seq, std::string& rev_seq) const {
+    /* Reverses the order of the minimizers in a digested sequence, DNA minimizers keep their letters in order */
+    size_t symbol_length = (use_promotions) ? 1 : k;
+    size_t num_symbols = seq.length() / symbol_length;
+    rev_seq.resize(num_symbols * symbol_length);
+
+    for (size_t i = 0; i < num_symbols; i++)
+        seq.copy(&rev_seq[(num_symbols - 1 - i) * symbol_length], symbol_length, i * symbol_length);
+}
+
+size_t MinimizerDigester::digest(std::string& seq) {
+    /* Replaces the sequence with its minimizers, the old buffer is kept to use for the next one */
+    digest(seq.data(), seq.length(), buffer);
+    seq.swap(buffer);
+    return seq.length();
+}
+
+bool MinimizerDigester::can_use_pieces(const char* seq, size_t length) {
+    /* Checks whether the sequence can be digested in pieces, non-ACGT characters reset the hasher */
+    if (length < window_span + 2 * DIGEST_PIECE_WINDOWS)
+        return false;
+    for (size_t i = 0; i < length; i++) {
+        if (seq[i] != 'A' && seq[i] != 'C' && seq[i] != 'G' && seq[i] != 'T')
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,161 @@
+ /*
+  * File: numa_utils.cpp
+  * Description: Detects the NUMA layout of the machine, and provides
+  *              helpers to pin threads and place the index memory
+  *              on specific nodes.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <numa_utils.hpp>
+#include <fstream>
+#include <algorithm>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+/* Memory policy modes from linux/mempolicy.h */
+#define SPUMONI_MPOL_DEFAULT 0
+#define SPUMONI_MPOL_PREFERRED 1
+#define SPUMONI_MPOL_BIND 2
+#define SPUMONI_MPOL_INTERLEAVE 3
+#define SPUMONI_MPOL_F_NODE 1
+#define SPUMONI_MPOL_F_ADDR 2
+
+NumaTopology::NumaTopology() {
+    /* Reads the node to cpu mapping from sysfs, restricted to cpus this process can run on */
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    bool have_mask = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    auto is_allowed = [&](int cpu) {return !have_mask || CPU_ISSET(cpu, &allowed);};
+
+    std::ifstream online_file ("/sys/devices/system/node/online");
+    std::string line = "";
+    if (std::getline(online_file, line)) {
+        for (int node: parse_cpu_list(line)) {
+            std::ifstream cpu_file ("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string cpus = "";
+            if (!std::getline(cpu_file, cpus)) continue;
+
+            // skip memory-only nodes, or nodes we are not allowed to run on
+            std::vector<int> usable_cpus;
+            for (int cpu: parse_cpu_list(cpus)) {
+                if (is_allowed(cpu)) usable_cpus.push_back(cpu);
+            }
+            if (usable_cpus.empty()) continue;
+
+            node_ids.push_back(node);
+            node_cpus.push_back(usable_cpus);
+        }
+    }
+
+    // no NUMA information available, so treat machine as a single node
+    if (node_ids.empty()) {
+        std::vector<int> usable_cpus;
+        long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int cpu = 0; cpu < num_cpus; cpu++) {
+            if (is_allowed(cpu)) usable_cpus.push_back(cpu);
+        }
+        node_ids.push_back(0);
+        node_cpus.push_back(usable_cpus);
+    }
+}
+
+std::vector<int> NumaTopology::parse_cpu_list(const std::string& list) {
+    /* Parses the sysfs list format (e.g. 0-3,8,10-11) into a list of ids */
+    std::vector<int> ids;
+    for (auto& range: split(list, ',')) {
+        auto bounds = split(range, '-');
+        if (bounds.empty() || !is_integer(bounds[0])) continue;
+
+        int start = std::stoi(bounds[0]);
+        int end = (bounds.size() > 1 && is_integer(bounds[1])) ? std::stoi(bounds[1]) : start;
+        for (int i = start; i <= end; i++) ids.push_back(i);
+    }
+    return ids;
+}
+
+size_t NumaTopology::node_of_thread(size_t thread_id) const {
+    /* Threads are assigned to nodes in a round-robin fashion */
+    return thread_id % num_nodes();
+}
+
+bool NumaTopology::pin_thread(size_t thread_id) const {
+    /* Pins the calling thread to a single cpu on the node assigned to thread_id */
+    size_t node = node_of_thread(thread_id);
+    const std::vector<int>& cpus = node_cpus[node];
+    if (cpus.empty()) return false;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpus[(thread_id / num_nodes()) % cpus.size()], &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+bool NumaTopology::pin_thread_to_node(size_t node) const {
+    /* Pins the calling thread to any of the cpus on a node */
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu: node_cpus[node]) CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+bool NumaTopology::bind_memory_to_node(size_t node) const {
+    /* New allocations by the calling thread will be placed on the given node */
+    return set_memory_policy(SPUMONI_MPOL_BIND, {node_ids[node]});
+}
+
+bool NumaTopology::interleave_memory() const {
+    /* New allocations by the calling thread will be spread page-by-page across all nodes */
+    return set_memory_policy(SPUMONI_MPOL_INTERLEAVE, node_ids);
+}
+
+bool NumaTopology::reset_memory_policy() {
+    /* Goes back to the default first-touch policy */
+    return syscall(SYS_set_mempolicy, SPUMONI_MPOL_DEFAULT, nullptr, 0) == 0;
+}
+
+int NumaTopology::node_of_address(const void* addr) {
+    /* Returns the id of the node holding the page at addr, or -1 if it is not known */
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, addr, SPUMONI_MPOL_F_NODE | SPUMONI_MPOL_F_ADDR) != 0)
+        return -1;
+    return node;
+}
+
+bool NumaTopology::prefer_node_for_range(void* addr, size_t length, int node_id) {
+    /* Pages of the range that are not touched yet will be placed on the node if it has room, and elsewhere otherwise */
+    unsigned long max_bits = 0;
+    std::vector<unsigned long> node_mask = build_node_mask({node_id}, max_bits);
+    return syscall(SYS_mbind, addr, length, SPUMONI_MPOL_PREFERRED, node_mask.data(), max_bits, 0) == 0;
+}
+
+bool NumaTopology::set_memory_policy(int mode, const std::vector<int>& nodes) const {
+    /* Builds a node mask, and sets the memory policy of the calling thread */
+    unsigned long max_bits = 0;
+    std::vector<unsigned long> node_mask = build_node_mask(nodes, max_bits);
+    return syscall(SYS_set_mempolicy, mode, node_mask.data(), max_bits) == 0;
+}
+
+std::vector<unsigned long> NumaTopology::build_node_mask(const std::vector<int>& nodes, unsigned long& max_bits) {
+    /* Sets the bit of each node, and returns the number of bits to pass to the kernel */
+    int max_node = *std::max_element(nodes.begin(), nodes.end());
+    size_t bits_per_word = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> node_mask(max_node/bits_per_word + 1, 0);
+
+    for (int node: nodes)
+        node_mask[node/bits_per_word] |= (1UL << (node % bits_per_word));
+
+    // kernel only reads (maxnode - 1) bits, so we pass one extra
+    max_bits = node_mask.size() * bits_per_word + 1;
+    return node_mask;
+}
+
+void NumaTopology::print_node_throughput(const char* func, const std::vector<NodeStats>& stats, double seconds) const {
+    /* Prints the amount of work done by the threads on each node */
+    for (size_t node = 0; node < stats.size(); node++) {
+        FORCE_LOG(func, "numa node %d: %ld reads, %ld bases (%.3f Mbp/s)", node_ids[node], stats[node].reads,
+                  stats[node].bases, (stats[node].bases/1000000.0)/std::max(seconds, 1e-9));
+    }
+}
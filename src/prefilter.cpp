@@ -0,0 +1,191 @@
+ /*
+  * File: prefilter.cpp
+  * Description: Implements a blocked Bloom filter of the q-grams in
+  *              the indexed text, which is used to classify reads with
+  *              no long matches before they go through backward search.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <prefilter.hpp>
+#include <minimizer_digest.hpp>
+#include <cpu_dispatch.hpp>
+#include <algorithm>
+#include <cmath>
+
+static inline uint64_t mix_hash(uint64_t x) {
+    /* Finalizer from MurmurHash3, so every bit of the q-gram affects every bit of the hash */
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+Prefilter::Prefilter(size_t span, size_t num_items, double fp_rate): span(span) {
+    /* Sizes the filter for the number of q-grams and the false-positive rate that are given */
+    double num_bits = std::ceil(num_items * -std::log(fp_rate) / (std::log(2.0) * std::log(2.0)));
+    num_hashes = static_cast<size_t>(std::round(-std::log2(fp_rate)));
+    num_hashes = std::min(std::max(num_hashes, static_cast<size_t>(1)), static_cast<size_t>(PREFILTER_MAX_HASHES));
+
+    num_blocks = std::max(static_cast<size_t>(std::ceil(num_bits / (64 * PREFILTER_BLOCK_WORDS))), static_cast<size_t>(1));
+    blocks.assign(num_blocks * PREFILTER_BLOCK_WORDS, 0);
+}
+
+template <typename func_t>
+void Prefilter::for_each_gram(const char* seq, size_t length, func_t func) const {
+    /* Calls func(block, bits) for each q-gram, with the block it maps to and the hash used for its bits */
+    if (length < span) return;
+
+    // polynomial rolling hash over the q-gram, the base is odd so it is invertible mod 2^64
+    const uint64_t base = 0x100000001b3ULL;
+    uint64_t top_power = 1, hash = 0;
+    for (size_t i = 1; i < span; i++) {top_power *= base;}
+
+    for (size_t i = 0; i < length; i++) {
+        if (i >= span) {hash -= top_power * static_cast<uint8_t>(seq[i - span]);}
+        hash = hash * base + static_cast<uint8_t>(seq[i]);
+        if (i + 1 < span) continue;
+
+        uint64_t x = mix_hash(hash);
+        size_t block = static_cast<size_t>((static_cast<__uint128_t>(x) * num_blocks) >> 64);
+        func(block * PREFILTER_BLOCK_WORDS, mix_hash(x ^ 0x9E3779B97F4A7C15ULL));
+    }
+}
+
+void Prefilter::add(const char* seq, size_t length) {
+    /* Adds every q-gram of the sequence to the filter */
+    for_each_gram(seq, length, [&](size_t block, uint64_t bits) {
+        for (size_t i = 0; i < num_hashes; i++) {
+            size_t bit = (bits >> (9 * i)) & 511;
+            blocks[block + (bit >> 6)] |= (1ULL << (bit & 63));
+        }
+    });
+}
+
+size_t Prefilter::count_hits(const char* seq, size_t length) const {
+    /* Returns the number of q-grams in the sequence that are found in the filter */
+    size_t num_hits = 0;
+    for_each_gram(seq, length, [&](size_t block, uint64_t bits) {
+        bool found = true;
+        for (size_t i = 0; i < num_hashes && found; i++) {
+            size_t bit = (bits >> (9 * i)) & 511;
+            found = (blocks[block + (bit >> 6)] >> (bit & 63)) & 1;
+        }
+        num_hits += found;
+    });
+    return num_hits;
+}
+
+size_t Prefilter::serialize(std::ostream& out) {
+    /* Writes the prefilter to a file on disk */
+    size_t written_bytes = 0;
+    out.write((char *)&this->span, sizeof(this->span));
+    out.write((char *)&this->num_hashes, sizeof(this->num_hashes));
+    out.write((char *)&this->num_blocks, sizeof(this->num_blocks));
+    written_bytes += 3 * sizeof(size_t);
+
+    out.write((char *)this->blocks.data(), size_in_bytes());
+    written_bytes += size_in_bytes();
+    return written_bytes;
+}
+
+void Prefilter::load(std::istream& in) {
+    /* Loads a serialized prefilter */
+    in.read((char *)&this->span, sizeof(this->span));
+    in.read((char *)&this->num_hashes, sizeof(this->num_hashes));
+    in.read((char *)&this->num_blocks, sizeof(this->num_blocks));
+
+    blocks.resize(num_blocks * PREFILTER_BLOCK_WORDS);
+    in.read((char *)this->blocks.data(), size_in_bytes());
+    if (!in) {FATAL_ERROR("The prefilter file is truncated, please rebuild it with spumoni build -F.");}
+}
+
+size_t get_prefilter_span(bool use_promotions) {
+    /* Promoted minimizers are one symbol each, so their q-grams are shorter */
+    return (use_promotions) ? PREFILTER_MINIMIZER_SPAN : PREFILTER_DNA_SPAN;
+}
+
+template <typename func_t>
+static void for_each_ref_sequence(const std::string& ref_file, bool use_promotions, func_t func) {
+    /* Calls func on each sequence of the indexed text, the binary file of promoted minimizers is a single sequence */
+    std::ifstream in(ref_file, std::ios::binary);
+    if (use_promotions) {
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        func(text);
+        return;
+    }
+    const CpuKernels& kernels = get_cpu_kernels();
+    std::string line = "", curr_seq = "";
+    while (std::getline(in, line)) {
+        if (line.length() && line[0] == '>') {
+            if (curr_seq.length()) {func(curr_seq);}
+            curr_seq.clear();
+        } else {
+            kernels.to_upper(&line[0], line.length());
+            curr_seq.append(line);
+        }
+    }
+    if (curr_seq.length()) {func(curr_seq);}
+}
+
+void build_prefilter(const std::string& ref_file, const std::string& null_read_file, bool use_promotions,
+                     bool use_dna_letters, size_t k, size_t w, bool use_canonical, double fp_rate) {
+    /* Builds the prefilter from the indexed text, and reports how often it would reject null reads */
+    STATUS_LOG("build_prefilter", "building the prefilter of the reference q-grams");
+    auto start = std::chrono::system_clock::now();
+
+    // count the q-grams first, so the filter is sized only once
+    size_t span = get_prefilter_span(use_promotions), num_grams = 0;
+    for_each_ref_sequence(ref_file, use_promotions, [&](const std::string& seq) {
+        if (seq.length() >= span) {num_grams += seq.length() - span + 1;}
+    });
+    Prefilter prefilter(span, num_grams, fp_rate);
+    for_each_ref_sequence(ref_file, use_promotions, [&](const std::string& seq) {
+        prefilter.add(seq.data(), seq.length());
+    });
+
+    std::ofstream out(ref_file + ".prefilter", std::ios::binary);
+    prefilter.serialize(out);
+    out.close();
+    DONE_LOG((std::chrono::system_clock::now() - start));
+
+    // reads taken from the reference should pass, and the same reads reversed (null reads) should not
+    const CpuKernels& kernels = get_cpu_kernels();
+    MinimizerDigester digester (k, w, use_promotions, use_canonical);
+    std::vector<size_t> ref_hits, null_hits;
+    std::ifstream null_reads(null_read_file);
+    std::string line = "", rev_read = "";
+
+    auto count_read_hits = [&](std::string& read) {
+        if (use_promotions || use_dna_letters) {digester.digest(read);}
+        size_t hits = prefilter.count_hits(read.data(), read.length());
+        if (use_canonical) {
+            digester.reverse_minimizers(read, rev_read);
+            hits = std::max(hits, prefilter.count_hits(rev_read.data(), rev_read.length()));
+        }
+        return hits;
+    };
+    while (std::getline(null_reads, line)) {
+        if (line.empty() || line[0] == '>') continue;
+        kernels.to_upper(&line[0], line.length());
+        std::string read = line;
+        ref_hits.push_back(count_read_hits(read));
+
+        read.assign(line.rbegin(), line.rend());
+        null_hits.push_back(count_read_hits(read));
+    }
+
+    FORCE_LOG("build_prefilter", "prefilter uses %.2f MB for %ld q-grams of %ld symbols (%ld bits set per q-gram)",
+              prefilter.size_in_bytes()/(1024.0 * 1024.0), num_grams, span, prefilter.num_hashes);
+    for (size_t bound: {1, 5, 10}) {
+        auto rejected = [&](const std::vector<size_t>& hits) {
+            size_t num_rejected = std::count_if(hits.begin(), hits.end(), [&](size_t x) {return x < bound;});
+            return (hits.size()) ? (100.0 * num_rejected / hits.size()) : 0.0;
+        };
+        FORCE_LOG("build_prefilter", "with -F %ld, %.1f%% of null reads and %.1f%% of reference reads are rejected",
+                  bound, rejected(null_hits), rejected(ref_hits));
+    }
+}
@@ -0,0 +1,74 @@
+ /*
+  * File: read_cache.cpp
+  * Description: Implements a sharded cache of MS/PML results that
+  *              is keyed by the read sequence, and evicts the least
+  *              recently used reads once its memory limit is reached.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <read_cache.hpp>
+#include <functional>
+
+ReadCache::ReadCache(size_t max_bytes) {
+    /* Splits the memory limit evenly across the shards */
+    max_shard_bytes = max_bytes / READ_CACHE_SHARDS;
+}
+
+ReadCache::Shard& ReadCache::shard_of(const std::string& read) {
+    /* Picks the shard using the top bits, since the map buckets use the bottom ones */
+    size_t hash = std::hash<std::string>{}(read);
+    return shards[(hash >> 32) % READ_CACHE_SHARDS];
+}
+
+std::shared_ptr<const CachedResult> ReadCache::find(const std::string& read) {
+    /* Returns the results of the read if present, and marks it as recently used */
+    Shard& shard = shard_of(read);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto it = shard.index.find(read);
+    if (it == shard.index.end()) {
+        num_misses++;
+        return nullptr;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    num_hits++;
+    return it->second->second;
+}
+
+void ReadCache::insert(const std::string& read, std::shared_ptr<const CachedResult> result) {
+    /* Adds the results of a read, and evicts the least recently used ones to stay under the limit */
+    size_t entry_bytes = 2 * read.length() + result->num_bytes() + READ_CACHE_ENTRY_OVERHEAD; // key is in the list and map
+    if (entry_bytes > max_shard_bytes) return;
+
+    Shard& shard = shard_of(read);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    // another thread may have queried the same read at the same time
+    if (shard.index.find(read) != shard.index.end()) return;
+
+    while (shard.num_bytes + entry_bytes > max_shard_bytes && !shard.entries.empty()) {
+        auto& oldest = shard.entries.back();
+        shard.num_bytes -= 2 * oldest.first.length() + oldest.second->num_bytes() + READ_CACHE_ENTRY_OVERHEAD;
+        shard.index.erase(oldest.first);
+        shard.entries.pop_back();
+        num_evictions++;
+    }
+
+    shard.entries.emplace_front(read, std::move(result));
+    shard.index.emplace(read, shard.entries.begin());
+    shard.num_bytes += entry_bytes;
+}
+
+void ReadCache::print_stats(const char* func) const {
+    /* Logs how often reads were found in the cache */
+    size_t hits = num_hits.load(), misses = num_misses.load();
+    size_t used_bytes = 0, num_entries = 0;
+    for (const Shard& shard: shards) {
+        used_bytes += shard.num_bytes;
+        num_entries += shard.entries.size();
+    }
+    double hit_rate = (hits + misses) ? (100.0 * hits / (hits + misses)) : 0.0;
+    FORCE_LOG(func, "dedup cache: %ld hits, %ld misses (%.1f%% hit rate), %ld evictions, %ld reads in %.1f MB",
+              hits, misses, hit_rate, num_evictions.load(), num_entries, used_bytes/(1024.0 * 1024.0));
+}
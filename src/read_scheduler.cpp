@@ -0,0 +1,131 @@
+ /*
+  * File: read_scheduler.cpp
+  * Description: Implements the scheduler that splits the query file
+  *              into tasks of reads, and balances them across threads
+  *              with per-thread queues and work stealing.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <read_scheduler.hpp>
+#include <algorithm>
+
+bool ReadTask::grabNextRead(Read& curr_read) {
+    /* Moves the next read of the task into curr_read, returns false once all of them are taken */
+    if (next_read == reads.size()) return false;
+    curr_read = std::move(reads[next_read++]);
+    return true;
+}
+
+ReadScheduler::ReadScheduler(std::ifstream& input, size_t num_threads, size_t min_task_bases, size_t max_task_bases):
+                             input(input), num_threads(std::max(num_threads, static_cast<size_t>(1))),
+                             min_task_bases(min_task_bases), max_task_bases(std::max(max_task_bases, min_task_bases)) {
+    /* Creates an empty queue for each thread, tasks start at the smallest size until they are timed */
+    queues.reset(new TaskQueue[this->num_threads]);
+    task_bases.store(min_task_bases);
+}
+
+bool ReadScheduler::next_task(size_t thread_id, ReadTask& task) {
+    /* Gives the thread its next task, and returns false once the whole file has been handed out */
+    while (true) {
+        if (pop_task(thread_id, task)) return true;
+        if (!refill(thread_id)) return pop_task(thread_id, task); // another thread may have refilled before the end
+    }
+}
+
+bool ReadScheduler::pop_task(size_t thread_id, ReadTask& task) {
+    /* Takes the front of the thread's own queue, otherwise steals from the back of another queue */
+    for (size_t i = 0; i < num_threads; i++) {
+        TaskQueue& queue = queues[(thread_id + i) % num_threads];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.tasks.empty()) continue;
+
+        if (i == 0) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        } else {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            num_steals++;
+        }
+        return true;
+    }
+    return false;
+}
+
+bool ReadScheduler::refill(size_t thread_id) {
+    /*
+     * Loads the next part of the file, and deals its tasks out to the queues starting
+     * with the calling thread. Short reads are grouped until a task has enough bases,
+     * and longer reads get a task of their own. Returns false at the end of the file.
+     */
+    std::lock_guard<std::mutex> input_guard(input_lock);
+    if (input_done) return false;
+
+    // another thread may have refilled the queues while this one waited
+    for (size_t i = 0; i < num_threads; i++) {
+        std::lock_guard<std::mutex> guard(queues[i].lock);
+        if (!queues[i].tasks.empty()) return true;
+    }
+
+    size_t curr_task_bases = task_bases.load();
+    size_t refill_bases = std::min(curr_task_bases * num_threads * SCHED_TASKS_PER_THREAD, static_cast<size_t>(SCHED_MAX_REFILL_BASES));
+    if (!loader.loadBatch(input, std::max(refill_bases, curr_task_bases))) {
+        input_done = true;
+        return false;
+    }
+
+    std::vector<ReadTask> new_tasks;
+    ReadTask curr_task;
+    Read read_struct;
+    while (loader.grabNextRead(read_struct)) {
+        size_t read_length = read_struct.seq.length();
+        if (read_length >= curr_task_bases) {
+            ReadTask long_task;
+            long_task.num_bases = read_length;
+            long_task.reads.push_back(std::move(read_struct));
+            new_tasks.push_back(std::move(long_task));
+            continue;
+        }
+        curr_task.num_bases += read_length;
+        curr_task.reads.push_back(std::move(read_struct));
+        if (curr_task.num_bases >= curr_task_bases) {
+            new_tasks.push_back(std::move(curr_task));
+            curr_task = ReadTask();
+        }
+    }
+    if (curr_task.reads.size()) {new_tasks.push_back(std::move(curr_task));}
+
+    // longest tasks go first, so the short ones fill in the gaps at the end
+    std::stable_sort(new_tasks.begin(), new_tasks.end(), [](const ReadTask& a, const ReadTask& b) {
+        return a.num_bases > b.num_bases;
+    });
+    for (size_t i = 0; i < new_tasks.size(); i++) {
+        TaskQueue& queue = queues[(thread_id + i) % num_threads];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(new_tasks[i]));
+    }
+    num_tasks += new_tasks.size();
+    num_refills++;
+    return true;
+}
+
+void ReadScheduler::record_task(size_t num_bases, double seconds) {
+    /* Updates the average time per base with a finished task, and resizes the next tasks to match the target time */
+    if (num_bases == 0 || seconds <= 0.0) return;
+    std::lock_guard<std::mutex> guard(timing_lock);
+
+    double task_ns_per_base = seconds * 1e9 / num_bases;
+    ns_per_base = (ns_per_base == 0.0) ? task_ns_per_base
+                                       : ((1.0 - SCHED_SMOOTHING) * ns_per_base + SCHED_SMOOTHING * task_ns_per_base);
+
+    size_t target_bases = static_cast<size_t>(SCHED_TARGET_TASK_MS * 1e6 / ns_per_base);
+    task_bases.store(std::min(std::max(target_bases, min_task_bases), max_task_bases));
+}
+
+void ReadScheduler::print_stats(const char* func) const {
+    /* Logs how the reads were split up and balanced across the threads */
+    FORCE_LOG(func, "scheduler: %ld tasks from %ld refills, %ld tasks were stolen, tasks ended at %ld bases",
+              num_tasks.load(), num_refills.load(), num_steals.load(), task_bases.load());
+}
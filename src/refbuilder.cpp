@@ -15,6 +15,9 @@
 #include <iostream>
 #include <zlib.h>  
 #include <encoder.h>
+#include <minimizer_digest.hpp>
+#include <cpu_dispatch.hpp>
+#include <seq_table.hpp>
 #include <filesystem>
 
 
@@ -33,7 +36,7 @@ char comp_tab[] = {
 RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char* output_file, const char* null_reads,  
                        bool build_doc, bool file_list, bool use_minimizers,
                        bool use_promotions, bool use_dna_letters, 
-                       size_t k, size_t w, bool use_rev_comp): using_doc(build_doc), using_list(file_list) {
+                       size_t k, size_t w, bool use_rev_comp, bool use_canonical): using_doc(build_doc), using_list(file_list) {
     /* Performs the needed operations to generate a single input file. */
 
     // Verify every file in the list is valid 
@@ -43,6 +46,8 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
     std::ifstream input_fd (list_file, std::ifstream::in);
     std::vector<std::string> input_files;
     std::vector<size_t> document_ids;
+    std::vector<std::vector<std::string>> group_labels; // labels at the coarser levels for each document ID
+    size_t num_columns = 0;
 
     while (std::getline(input_fd, line)) {
         auto word_list = split(line, ' ');
@@ -66,6 +71,15 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
                 if (std::stoi(word_list[1]) == (curr_id+1)) {curr_id+=1;}
                 document_ids.push_back(std::stoi(word_list[1]));
             } else {FATAL_ERROR("The IDs in the file_list must be staying constant or increasing by 1.");}
+
+            // Any further columns are labels of the ID at coarser levels (e.g. species, genus)
+            std::vector<std::string> labels (word_list.begin() + 2, word_list.end());
+            if (member_num == 0) {num_columns = word_list.size();}
+            if (word_list.size() != num_columns)
+                FATAL_ERROR("Every line of the file_list needs the same number of label columns.");
+            if (group_labels.size() < curr_id) {group_labels.push_back(labels);}
+            else if (group_labels[curr_id-1] != labels)
+                FATAL_ERROR("The files with document ID %ld do not have the same labels in the file_list.", curr_id);
         }
         member_num += 1;
     }
@@ -78,6 +92,7 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
     // Open file to write all the sequences to
     std::ofstream output_fd (output_file, std::ofstream::out);
     std::string mseq = "";
+    MinimizerDigester digester (k, w, use_promotions, use_canonical); // reused for every sequence
 
     // Initialize variables needs for over-sampling of reads for null database
     srand(0);
@@ -93,6 +108,8 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
     gzFile fp;
     kseq_t* seq;
     std::vector<size_t> seq_lengths;
+    SequenceTable seq_table; // where each sequence starts in the text, for reference coordinates
+    size_t prev_length = 0;
 
     curr_id = 1;
     size_t curr_id_seq_length = 0;
@@ -134,17 +151,19 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
             
             // Convert forward_seq to minimizers by default, or save as DNA if asked
             if (use_promotions) {
-                mseq = perform_minimizer_digestion(seq->seq.s, k, w);
+                digester.digest(seq->seq.s, seq->seq.l, mseq);
                 output_fd << mseq;
                 curr_id_seq_length += mseq.length();
             } else if (use_dna_letters) {
-                mseq = perform_dna_minimizer_digestion(seq->seq.s, k, w);
+                digester.digest(seq->seq.s, seq->seq.l, mseq);
                 output_fd << '>' << seq->name.s << '\n' << mseq << '\n';
                 curr_id_seq_length += mseq.length();
             } else {
                 output_fd << '>' << seq->name.s << '\n' << seq->seq.s << '\n';
                 curr_id_seq_length += seq->seq.l;
             }
+            seq_table.add(seq->name.s, curr_id_seq_length - prev_length, false);
+            prev_length = curr_id_seq_length;
 
         
             // Get reverse complement, and print it
@@ -164,17 +183,19 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
 
                 // Convert rev_comp seq to minimizers by default, otherwise DNA
                 if (use_promotions) {
-                    mseq = perform_minimizer_digestion(seq->seq.s, k, w);
+                    digester.digest(seq->seq.s, seq->seq.l, mseq);
                     output_fd << mseq;
                     curr_id_seq_length += mseq.length();
                 } else if (use_dna_letters) {
-                    mseq = perform_dna_minimizer_digestion(seq->seq.s, k, w);
+                    digester.digest(seq->seq.s, seq->seq.l, mseq);
                     output_fd << '>' << seq->name.s << '\n' << mseq << '\n';
                     curr_id_seq_length += mseq.length();
                 } else {
                     output_fd << '>' << seq->name.s << "_rev_comp" << '\n' << seq->seq.s << '\n';
                     curr_id_seq_length += seq->seq.l;
                 }
+                seq_table.add(seq->name.s, curr_id_seq_length - prev_length, true);
+                prev_length = curr_id_seq_length;
             }
         }
         kseq_destroy(seq);
@@ -184,11 +205,11 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
             // Check if we are transitioning to a new group
             if (iter_index < document_ids.size()-1 && document_ids[iter_index] != document_ids[iter_index+1]){
                 seq_lengths.push_back(curr_id_seq_length);
-                curr_id += 1; curr_id_seq_length = 0;
+                curr_id += 1; curr_id_seq_length = 0; prev_length = 0;
             // If last file, output current sequence length
             } else if (iter_index == document_ids.size()-1){
                 seq_lengths.push_back(curr_id_seq_length);
-                curr_id_seq_length = 0;}
+                curr_id_seq_length = 0; prev_length = 0;}
         }
     }
     output_fd.close(); 
@@ -204,6 +225,9 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
 
     // Assign the full reference to the attribute
     input_file = output_file;
+    std::ofstream output_seq_table (input_file + SequenceTable::get_file_extension(), std::ofstream::binary);
+    seq_table.serialize(output_seq_table);
+    output_seq_table.close();
     if (!using_doc) return;
     ASSERT((curr_id == document_ids.back()), "Issue with building the FASTA document index.");
 
@@ -211,7 +235,9 @@ RefBuilder::RefBuilder(const char* ref_file, const char* list_file, const char*
     std::ofstream output_fdi (input_file + ".fdi", std::ofstream::out);
     for (auto iter = seq_lengths.begin(); iter != seq_lengths.end(); ++iter) {
         size_t iter_index = iter - seq_lengths.begin() + 1;
-        output_fdi << "group_" << iter_index << '\t' << *iter << '\n';
+        output_fdi << "group_" << iter_index << '\t' << *iter;
+        for (auto& label: group_labels[iter_index-1]) {output_fdi << '\t' << label;}
+        output_fdi << '\n';
     }
     output_fdi.close();
 }
@@ -315,7 +341,7 @@ std::string RefBuilder::parse_null_reads_from_general_text(const char* ref_file,
 }
 
 std::string RefBuilder::build_reference(const char* ref_file, const char* output_path,bool use_promotions, bool use_dna_letters,
-                                        size_t k, size_t w, bool use_rev_comp) {
+                                        size_t k, size_t w, bool use_rev_comp, bool use_canonical) {
     /*
      * Builds the reference file from a single file, it could using either type
      * of minimizer digestion: promotion or DNA. Or just use the original FASTA
@@ -329,26 +355,32 @@ std::string RefBuilder::build_reference(const char* ref_file, const char* output
     kseq_t* seq = kseq_init(fp);
     size_t total_length = 0;
 
+    // The digester and output buffer are reused for every sequence
+    const CpuKernels& kernels = get_cpu_kernels();
+    MinimizerDigester digester (k, w, use_promotions, use_canonical);
+    std::string curr_seq = "";
+    SequenceTable seq_table; // where each sequence starts in the text, for reference coordinates
+    size_t prev_length = 0;
+
     while (kseq_read(seq)>=0) {
-        std::string curr_seq = "";
 
         // Upper-case every letter in the sequence
-		for (size_t i = 0; i < seq->seq.l; ++i)
-			seq->seq.s[i] = std::toupper(seq->seq.s[i]);
+        kernels.to_upper(seq->seq.s, seq->seq.l);
 
         // Print out the forward seq
         if (use_promotions) {
-            curr_seq = perform_minimizer_digestion(seq->seq.s, k, w);
+            digester.digest(seq->seq.s, seq->seq.l, curr_seq);
             output_fd << curr_seq; total_length += curr_seq.size();
         } else if (use_dna_letters) {
-            curr_seq = perform_dna_minimizer_digestion(seq->seq.s, k, w);
+            digester.digest(seq->seq.s, seq->seq.l, curr_seq);
             output_fd << '>' << seq->name.s << '\n' << curr_seq << '\n';
             total_length += curr_seq.size();
         } else {
             output_fd << '>' << seq->name.s << '\n' << seq->seq.s << '\n';
             total_length += seq->seq.l;
         }
-        curr_seq = "";
+        seq_table.add(seq->name.s, total_length - prev_length, false);
+        prev_length = total_length;
 
         // Get reverse complement, and print it
         // Based on seqtk reverse complement code, that does it 
@@ -366,16 +398,18 @@ std::string RefBuilder::build_reference(const char* ref_file, const char* output
 
             // Print out the reverse complement sequence
             if (use_promotions) {
-                curr_seq = perform_minimizer_digestion(seq->seq.s, k, w);
+                digester.digest(seq->seq.s, seq->seq.l, curr_seq);
                 output_fd << curr_seq; total_length += curr_seq.size();
             } else if (use_dna_letters) {
-                curr_seq = perform_dna_minimizer_digestion(seq->seq.s, k, w);
+                digester.digest(seq->seq.s, seq->seq.l, curr_seq);
                 output_fd << '>' << seq->name.s << "_rev_comp" <<'\n' << curr_seq << '\n';
                 total_length += curr_seq.size();
             } else {
                 output_fd << '>' << seq->name.s << "_rev_comp" <<'\n' << seq->seq.s << '\n';
                 total_length += seq->seq.l;
             }
+            seq_table.add(seq->name.s, total_length - prev_length, true);
+            prev_length = total_length;
         }
     }
 
@@ -389,7 +423,18 @@ std::string RefBuilder::build_reference(const char* ref_file, const char* output
     kseq_destroy(seq);
     gzclose(fp);
     output_fd.close();
+
+    std::ofstream output_seq_table (std::string(output_path) + SequenceTable::get_file_extension(), std::ofstream::binary);
+    seq_table.serialize(output_seq_table);
+    output_seq_table.close();
     return output_path;
 }
 
-
+void RefBuilder::reverse_complement(const std::string& seq, std::string& rc_seq) {
+    /* Writes the reverse complement of seq into rc_seq, bytes outside of the complement table are kept */
+    rc_seq.resize(seq.length());
+    for (size_t i = 0; i < seq.length(); i++) {
+        uint8_t c = static_cast<uint8_t>(seq[seq.length() - 1 - i]);
+        rc_seq[i] = (c < sizeof(comp_tab)) ? comp_tab[c] : static_cast<char>(c);
+    }
+}
@@ -0,0 +1,86 @@
+ /*
+  * File: seq_table.cpp
+  * Description: Implements the table of sequence boundaries in the
+  *              indexed text, which translates text positions into
+  *              reference coordinates.
+  *
+  * Start Date: October 16, 2026
+  */
+
+#include <spumoni_main.hpp>
+#include <seq_table.hpp>
+#include <algorithm>
+#include <numeric>
+
+void SequenceTable::add(const std::string& name, size_t length, bool reverse) {
+    /* Adds the next sequence written to the text */
+    if (starts.empty()) {starts.push_back(0);}
+    names.push_back(name);
+    is_reverse.push_back(reverse);
+    starts.push_back(starts.back() + length);
+}
+
+void SequenceTable::locate(std::vector<RefCoord>& coords) const {
+    /*
+     * Finds the sequence and offset of each match. The matches are looked up in order of
+     * text position, so each binary search starts from the sequence of the previous one.
+     */
+    if (names.empty()) return;
+    std::vector<size_t> order(coords.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {return coords[a].text_pos < coords[b].text_pos;});
+
+    auto search_start = starts.begin() + 1;
+    for (size_t i: order) {
+        RefCoord& coord = coords[i];
+        auto seq_end = std::upper_bound(search_start, starts.end(), coord.text_pos);
+        if (seq_end == starts.end()) {seq_end--;} // the text terminator goes with the last sequence
+        search_start = seq_end;
+
+        coord.seq_id = (seq_end - starts.begin()) - 1;
+        coord.reverse = is_reverse[coord.seq_id];
+        size_t seq_start = starts[coord.seq_id], seq_length = *seq_end - seq_start;
+        size_t offset = std::min(coord.text_pos - seq_start, seq_length);
+
+        // the start on the forward strand is where the match ends on the reverse complement
+        coord.offset = (coord.reverse) ? (seq_length - std::min(offset + coord.length, seq_length)) : offset;
+    }
+}
+
+size_t SequenceTable::serialize(std::ostream& out) const {
+    /* Writes the number of sequences, and then the length, strand and name of each one */
+    size_t written_bytes = 0, num_seqs = names.size();
+    out.write((char *)&num_seqs, sizeof(num_seqs));
+    written_bytes += sizeof(num_seqs);
+
+    for (size_t i = 0; i < num_seqs; i++) {
+        size_t length = starts[i+1] - starts[i], name_length = names[i].length();
+        uint8_t reverse = is_reverse[i];
+        out.write((char *)&length, sizeof(length));
+        out.write((char *)&reverse, sizeof(reverse));
+        out.write((char *)&name_length, sizeof(name_length));
+        out.write(names[i].data(), name_length);
+        written_bytes += 2 * sizeof(size_t) + sizeof(reverse) + name_length;
+    }
+    return written_bytes;
+}
+
+void SequenceTable::load(std::istream& in) {
+    /* Loads a serialized table */
+    size_t num_seqs = 0;
+    in.read((char *)&num_seqs, sizeof(num_seqs));
+    names.clear(); starts.clear(); is_reverse.clear();
+
+    std::string name = "";
+    for (size_t i = 0; i < num_seqs; i++) {
+        size_t length = 0, name_length = 0;
+        uint8_t reverse = 0;
+        in.read((char *)&length, sizeof(length));
+        in.read((char *)&reverse, sizeof(reverse));
+        in.read((char *)&name_length, sizeof(name_length));
+        name.resize(name_length);
+        in.read(&name[0], name_length);
+        add(name, length, reverse);
+    }
+    if (!in) {FATAL_ERROR("The sequence table is truncated, please rebuild the index with spumoni build.");}
+}
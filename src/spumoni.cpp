@@ -20,7 +20,9 @@
 #include <doc_array.hpp>
 #include <refbuilder.hpp>
 #include <encoder.h>
+#include <minimizer_digest.hpp>
 #include <emp_null_database.hpp>
+#include <prefilter.hpp>
 #include <getopt.h>
 
 /*
@@ -37,7 +39,15 @@ int spumoni_run_usage () {
     std::fprintf(stderr, "Options:\n");
     std::fprintf(stderr, "\tGeneral options:\n");
     std::fprintf(stderr, "\t%-35sprints this usage message\n", "-h, --help");
-    std::fprintf(stderr, "\t%-25s%-10snumber of helper threads (default: 1)\n\n", "-t, --threads", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10snumber of helper threads (default: 1)\n", "-t, --threads", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10splace index on NUMA nodes and pin threads: interleave or replicate\n", "-N, --numa", "[STR]");
+    std::fprintf(stderr, "\t%-25s%-10sback the index with 2 MB huge pages if available\n", "-H, --huge-pages", "");
+    std::fprintf(stderr, "\t%-25s%-10sthresholds to load: bv, plain or compressed (default: detected)\n", "-T, --thr-type", "[STR]");
+    std::fprintf(stderr, "\t%-25s%-10sRLBWT bitvectors to load: sd or hyb (default: detected)\n", "-R, --rlbwt", "[STR]");
+    std::fprintf(stderr, "\t%-25s%-10smemory in MB for caching results of duplicate reads (default: 0, off)\n", "-D, --dedup-cache", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10squery each batch of reads together, sharing common suffixes\n", "-B, --suffix-batch", "");
+    std::fprintf(stderr, "\t%-25s%-10squery each batch of reads in order of their last symbols\n", "-O, --reorder", "");
+    std::fprintf(stderr, "\t%-25s%-10sskip reads with fewer prefilter hits, needs an index built with -F\n\n", "-F, --prefilter", "[INT]");
 
     std::fprintf(stderr, "\tInput/output options:\n");
     std::fprintf(stderr, "\t%-25s%-10soutput prefix used for index\n", "-r, --ref", "[FILE]");
@@ -46,13 +56,21 @@ int spumoni_run_usage () {
     std::fprintf(stderr, "\t%-25s%-10suse index to compute PMLs\n", "-P, --PML", "");
     std::fprintf(stderr, "\t%-25s%-10spattern file is general text (default: FASTA)\n", "-g, --general", "");
     std::fprintf(stderr, "\t%-25s%-10suse document array to get assignments\n", "-d, --doc-array", "");
+    std::fprintf(stderr, "\t%-25s%-10slist the documents of each maximal match at least this long (*.doc_lists)\n", "-l, --doc-list", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10sLF steps spent listing one match before it is cut short and marked with * (default: 4096, 0 for no bound)\n", "-S, --doc-list-steps", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10sassign reads to documents (and labels above) by length-weighted vote, ties: split, unique, lowest or lca\n", "-V, --doc-vote", "[STR]");
+    std::fprintf(stderr, "\t%-25s%-10splace maximal matches at least this long in the reference, needs -M and -n (*.ref_coords)\n", "-x, --ref-coords", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10sonly write maximal matches at least this long instead of every MS, needs -M (*.mems)\n", "-e, --mems", "[INT]");
+    std::fprintf(stderr, "\t%-25s%-10slocate up to this many occurrences of each MEM with -e (0 for all)\n", "-o, --mem-occs", "[INT]");
     std::fprintf(stderr, "\t%-25s%-10swrite out the classifications in a report file\n", "-c, --classify", "");
+    std::fprintf(stderr, "\t%-25s%-10salso query reverse complement of reads, for indexes built with -c (*.strands)\n", "-s, --both-strands", "");
     std::fprintf(stderr, "\t%-25s%-10ssize of region in bp for classification (default: 150)\n\n", "-w, --window", "[INT]");
 
     std::fprintf(stderr, "\tMinimizer options:\n");
     std::fprintf(stderr, "\t%-25s%-10sturn off minimizer digestion of reads (default: on)\n", "-n, --no-digest", "");
     std::fprintf(stderr, "\t%-25s%-10suse alphabet-promoted minimizers\n", "-m, --minimizer-alphabet", "");
     std::fprintf(stderr, "\t%-25s%-10suse DNA-letter based minimizers\n", "-a, --dna-minimizer", "");
+    std::fprintf(stderr, "\t%-25s%-10suse canonical minimizers, needed for indexes built with -C\n", "-C, --canonical", "");
     std::fprintf(stderr, "\t%-25s%-10ssmall window size (k) for finding minimizers (default: 4)\n", "-K, --small-window",  "[INT]");
     std::fprintf(stderr, "\t%-25s%-10slarge window size (w) for finding minimizers (default: 11)\n\n", "-W, --large-window", "[INT]");
 
@@ -72,7 +90,7 @@ int spumoni_build_usage () {
 
     std::fprintf(stderr, "\tInput data options:\n");
     std::fprintf(stderr, "\t%-25s%-10spath to reference file to be indexed (default: FASTA)\n", "-r, --ref", "[FILE]");
-    std::fprintf(stderr, "\t%-25s%-10sfile with a list of FASTA files to index\n", "-i, --filelist", "[FILE]");
+    std::fprintf(stderr, "\t%-25s%-10sfile with a list of FASTA files to index, a document ID and optional labels per line\n", "-i, --filelist", "[FILE]");
     //std::fprintf(stderr, "\t%-25s%-10sbuild directory for index(es) (if using -i option)\n", "-b, --build-dir", "[DIR]");
     std::fprintf(stderr, "\t%-25s%-10suse with -r option if input file is general text (default: false)\n", "-g, --general-text", "");
     std::fprintf(stderr, "\t%-25s%-10sdo not add reverse complement, only applies to FASTA (default: true)\n\n", "-c, --no-rev-comp", "");
@@ -81,6 +99,7 @@ int spumoni_build_usage () {
     std::fprintf(stderr, "\t%-25s%-10sturn off minimizer digestion of sequence (default: on)\n", "-n, --no-digest", "");
     std::fprintf(stderr, "\t%-25s%-10suse alphabet-promoted minimizers\n", "-m, --minimizer-alphabet", "");
     std::fprintf(stderr, "\t%-25s%-10suse DNA-letter based minimizers\n", "-t, --dna-minimizer", "");
+    std::fprintf(stderr, "\t%-25s%-10suse canonical minimizers, and leave out the reverse complement\n", "-C, --canonical", "");
     std::fprintf(stderr, "\t%-25s%-10ssmall window size (k) for finding minimizers (default: 4)\n", "-K, --small-window", "[INT]");
     std::fprintf(stderr, "\t%-25s%-10slarge window size (w) for finding minimizers (default: 11)\n\n", "-W, --large-window", "[INT]");
 
@@ -90,6 +109,13 @@ int spumoni_build_usage () {
     std::fprintf(stderr, "\t%-25s%-10sbuild an index that can be used to compute PMLs\n", "-P, --PML", "");
     std::fprintf(stderr, "\t%-25s%-10skeep the temporary files (default: false)\n", "-k, --keep", "");
     std::fprintf(stderr, "\t%-25s%-10sbuild the document array (default: false)\n", "-d, --doc-array", "");
+    std::fprintf(stderr, "\t%-25s%-10srun-length encode the document array (*.rldoc)\n", "-L, --rl-doc", "");
+    std::fprintf(stderr, "\t%-25s%-10sthresholds to build: bv, plain, compressed or all,\n", "-T, --thr-type", "[STR]");
+    std::fprintf(stderr, "\t%-35sa comma-separated list builds several (default: bv)\n", "");
+    std::fprintf(stderr, "\t%-25s%-10sRLBWT bitvectors to build: sd (Elias-Fano), hyb (hybrid) or all,\n", "-R, --rlbwt", "[STR]");
+    std::fprintf(stderr, "\t%-35sa comma-separated list builds several (default: sd)\n", "");
+    std::fprintf(stderr, "\t%-25s%-10sbuild a q-gram prefilter with this false-positive rate (e.g. 0.01)\n", "-F, --prefilter", "[FLOAT]");
+    std::fprintf(stderr, "\t%-25s%-10ssubsample the SA samples of the MS index, at most this many LF steps per lookup\n", "-s, --ssa-rate", "[INT]");
     std::fprintf(stderr, "\t%-25s%-10ssize of windows in bp for classification (default: 150)\n\n", "-w, --window", "[INT]");   
 
     //std::fprintf(stderr, "\t%-10ssliding window size (default: 10)\n", "-w [arg]");
@@ -115,6 +141,7 @@ void parse_build_options(int argc, char** argv, SpumoniBuildOptions* opts) {
         {"no-digest",   no_argument, NULL,  'n'},
         {"minimizer-alphabet",   no_argument, NULL,  'm'},
         {"dna-minimizer",   no_argument, NULL,  't'},
+        {"canonical",   no_argument, NULL,  'C'},
         {"small-window",  required_argument, NULL,  'K'},
         {"large-window",  required_argument, NULL,  'W'},
         {"MS",   no_argument, NULL,  'M'},
@@ -122,11 +149,16 @@ void parse_build_options(int argc, char** argv, SpumoniBuildOptions* opts) {
         {"keep",   no_argument, NULL,  'k'},
         {"doc-array",   no_argument, NULL,  'd'},
         {"window",  required_argument, NULL,  'w'},
+        {"thr-type",  required_argument, NULL,  'T'},
+        {"rlbwt",  required_argument, NULL,  'R'},
+        {"prefilter",  required_argument, NULL,  'F'},
+        {"rl-doc",  no_argument, NULL,  'L'},
+        {"ssa-rate",  required_argument, NULL,  's'},
         {0, 0, 0,  0}
     };
 
     int long_index = 0;
-    for(int c;(c = getopt_long(argc, argv, "ho:r:MPw:kdi:b:nvmK:W:tgc", long_options, &long_index)) >= 0;) { 
+    for(int c;(c = getopt_long(argc, argv, "ho:r:MPw:kdi:b:nvmK:W:tgcT:R:CF:Ls:", long_options, &long_index)) >= 0;) { 
         switch(c) {
                     case 'h': spumoni_build_usage(); std::exit(1);
                     case 'o': opts->output_prefix.assign(optarg); break;
@@ -150,11 +182,74 @@ void parse_build_options(int argc, char** argv, SpumoniBuildOptions* opts) {
                     case 'k': opts->keep_files = true; break;
                     //case 'f': opts->is_fasta = true; break;
                     case 'd': opts->build_doc = true; break;
+                    case 'T': opts->thr_types = parse_thresholds_list(optarg); break;
+                    case 'R': opts->bwt_types = parse_rlbwt_list(optarg); break;
+                    case 'C': opts->use_canonical = true; break;
+                    case 'F': opts->prefilter_fp = std::atof(optarg); break;
+                    case 'L': opts->rl_doc = true; break;
+                    case 's': opts->ssa_rate = std::max(std::atoi(optarg), 1); break;
                     default: spumoni_build_usage(); std::exit(1);
         }
     }
 }
 
+thresholds_type parse_thresholds_type(const char* name) {
+    /* Converts the name of a thresholds data-structure into its type */
+    if (std::strcmp(name, "bv") == 0) return THR_BV;
+    if (std::strcmp(name, "plain") == 0) return THR_PLAIN;
+    if (std::strcmp(name, "compressed") == 0) return THR_COMPRESSED;
+    FATAL_ERROR("Unrecognized thresholds type (%s), it should be bv, plain or compressed.", name);
+}
+
+std::vector<thresholds_type> parse_thresholds_list(const char* names) {
+    /* Converts the argument of the --thr-type build option into a list of types */
+    if (std::strcmp(names, "all") == 0) return {THR_BV, THR_PLAIN, THR_COMPRESSED};
+
+    std::vector<thresholds_type> thr_types;
+    for (auto& name: split(names, ',')) {
+        thresholds_type curr_type = parse_thresholds_type(name.data());
+        if (std::find(thr_types.begin(), thr_types.end(), curr_type) == thr_types.end())
+            thr_types.push_back(curr_type);
+    }
+    return thr_types;
+}
+
+rlbwt_type parse_rlbwt_type(const char* name) {
+    /* Converts the name of the RLBWT bitvectors into its type */
+    if (std::strcmp(name, "sd") == 0) return RLBWT_SD;
+    if (std::strcmp(name, "hyb") == 0) return RLBWT_HYB;
+    FATAL_ERROR("Unrecognized RLBWT type (%s), it should be sd or hyb.", name);
+}
+
+std::vector<rlbwt_type> parse_rlbwt_list(const char* names) {
+    /* Converts the argument of the --rlbwt build option into a list of types */
+    if (std::strcmp(names, "all") == 0) return {RLBWT_SD, RLBWT_HYB};
+
+    std::vector<rlbwt_type> bwt_types;
+    for (auto& name: split(names, ',')) {
+        rlbwt_type curr_type = parse_rlbwt_type(name.data());
+        if (std::find(bwt_types.begin(), bwt_types.end(), curr_type) == bwt_types.end())
+            bwt_types.push_back(curr_type);
+    }
+    return bwt_types;
+}
+
+numa_mode parse_numa_mode(const char* mode) {
+    /* Converts the argument of the --numa option into a placement mode */
+    if (std::strcmp(mode, "interleave") == 0) return NUMA_INTERLEAVE;
+    if (std::strcmp(mode, "replicate") == 0) return NUMA_REPLICATE;
+    FATAL_ERROR("Unrecognized NUMA placement mode (%s), it should be interleave or replicate.", mode);
+}
+
+vote_rule parse_vote_rule(const char* name) {
+    /* Converts the argument of the --doc-vote option into the rule used for ties */
+    if (std::strcmp(name, "split") == 0) return VOTE_SPLIT;
+    if (std::strcmp(name, "unique") == 0) return VOTE_UNIQUE;
+    if (std::strcmp(name, "lowest") == 0) return VOTE_LOWEST;
+    if (std::strcmp(name, "lca") == 0) return VOTE_LCA;
+    FATAL_ERROR("Unrecognized tie rule for the document vote (%s), it should be split, unique, lowest or lca.", name);
+}
+
 void parse_run_options(int argc, char** argv, SpumoniRunOptions* opts) {
     /* Parses the arguments for the build sub-command and returns a struct with arguments */
 
@@ -172,13 +267,29 @@ void parse_run_options(int argc, char** argv, SpumoniRunOptions* opts) {
         {"no-digest",   no_argument, NULL,  'n'},
         {"minimizer-alphabet",   no_argument, NULL,  'm'},
         {"dna-minimizer",   no_argument, NULL,  't'},
+        {"canonical",   no_argument, NULL,  'C'},
         {"small-window",  required_argument, NULL,  'K'},
         {"large-window",  required_argument, NULL,  'W'},
+        {"numa",  required_argument, NULL,  'N'},
+        {"huge-pages",  no_argument, NULL,  'H'},
+        {"thr-type",  required_argument, NULL,  'T'},
+        {"rlbwt",  required_argument, NULL,  'R'},
+        {"both-strands",  no_argument, NULL,  's'},
+        {"dedup-cache",  required_argument, NULL,  'D'},
+        {"suffix-batch",  no_argument, NULL,  'B'},
+        {"reorder",  no_argument, NULL,  'O'},
+        {"prefilter",  required_argument, NULL,  'F'},
+        {"doc-list",  required_argument, NULL,  'l'},
+        {"doc-list-steps",  required_argument, NULL,  'S'},
+        {"doc-vote",  required_argument, NULL,  'V'},
+        {"ref-coords",  required_argument, NULL,  'x'},
+        {"mems",  required_argument, NULL,  'e'},
+        {"mem-occs",  required_argument, NULL,  'o'},
         {0, 0, 0,  0}
     };
 
     int long_index = 0;
-    for(int c;(c = getopt_long(argc, argv, "hr:p:MPt:dcnmaK:W:w:g", long_options, &long_index)) >= 0;) { 
+    for(int c;(c = getopt_long(argc, argv, "hr:p:MPt:dcnmaK:W:w:gN:HT:R:sCD:BOF:l:S:V:x:e:o:", long_options, &long_index)) >= 0;) { 
         switch(c) {
                     case 'h': spumoni_run_usage(); std::exit(1);
                     case 'r': opts->ref_file.assign(optarg); break;
@@ -195,6 +306,22 @@ void parse_run_options(int argc, char** argv, SpumoniRunOptions* opts) {
                     case 'g': opts->is_general_text = true; break;
                     case 't': opts->threads = std::max(std::atoi(optarg), 1); break;
                     case 'd': opts->use_doc = true; break;
+                    case 'N': opts->numa_placement = parse_numa_mode(optarg); break;
+                    case 'H': opts->use_huge_pages = true; break;
+                    case 'T': opts->thr_type = parse_thresholds_type(optarg); break;
+                    case 'R': opts->bwt_type = parse_rlbwt_type(optarg); break;
+                    case 's': opts->both_strands = true; break;
+                    case 'D': opts->dedup_cache_mb = std::max(std::atoi(optarg), 0); break;
+                    case 'B': opts->suffix_batch = true; break;
+                    case 'O': opts->reorder_reads = true; break;
+                    case 'F': opts->prefilter_hits = std::max(std::atoi(optarg), 0); break;
+                    case 'l': opts->doc_list_length = std::max(std::atoi(optarg), 1); break;
+                    case 'S': opts->doc_list_max_steps = std::max(std::atoi(optarg), 0); break;
+                    case 'V': opts->doc_vote = parse_vote_rule(optarg); break;
+                    case 'x': opts->ref_coords_length = std::max(std::atoi(optarg), 1); break;
+                    case 'e': opts->mem_length = std::max(std::atoi(optarg), 1); break;
+                    case 'o': opts->locate_mems = true; opts->max_mem_occs = std::max(std::atoi(optarg), 0); break;
+                    case 'C': opts->use_canonical = true; break;
                     default: spumoni_run_usage(); std::exit(1);
         }
     }
@@ -286,54 +413,20 @@ std::string execute_cmd(const char* cmd) {
     return output;
 }
 
-std::string perform_minimizer_digestion(std::string input_query, size_t k, size_t w) {
+std::string perform_minimizer_digestion(const std::string& input_query, size_t k, size_t w, bool use_canonical) {
     /* Performs minimizer digestion using alphabet promotion, and returns concatenated minimizers */
-    bns::RollingHasher<uint8_t> rh(k, false, bns::DNA, w);
-    bool hp_compress = true;
-
+    MinimizerDigester digester (k, w, true, use_canonical);
     std::string mseq = "";
-    std::vector<uint8_t> mseq_vec;
-
-    // Define lambda function to take in a DNA sequence and return minimizer sequence
-    auto get_minimizer_seq = [&](std::string seq, size_t seq_length) {
-                mseq = ""; mseq_vec.clear();
-                rh.for_each_uncanon([&](auto x) { // Extracts all minimizers and stores in mseq
-                if(mseq_vec.empty() || !hp_compress || mseq_vec.back() != x) {
-                    // Important Note - I push onto the vector first because it is raw hash value
-                    // which we will check in the if statement. However, the real value we use in the
-                    // sequence could be changed to account for PFP's reserved characters
-                    mseq_vec.push_back(x);
-                    x = (x > 2) ? x : (x + 3); // Reserves 0,1,2 for PFP
-                    mseq += x;
-                }
-            }, seq.data(), seq_length);
-            return mseq;
-    };
-
-    return get_minimizer_seq(input_query, input_query.length());
+    digester.digest(input_query.data(), input_query.length(), mseq);
+    return mseq;
 }
 
-std::string perform_dna_minimizer_digestion(std::string input_query, size_t k, size_t w) {
+std::string perform_dna_minimizer_digestion(const std::string& input_query, size_t k, size_t w, bool use_canonical) {
     /* Generates string of concatenated minimizers in DNA alpahbet for input string, and returns it */
-    std::vector<uint16_t> sp_vec;
-    bns::Spacer sp(k, w, sp_vec);
-    bns::Encoder<bns::score::Lex, uint64_t> enc(sp, false);
-
-    bool hp_compress = true;
+    MinimizerDigester digester (k, w, false, use_canonical);
     std::string mseq = "";
-    std::vector<uint8_t> mseq_vec;
-    
-    auto get_minimizer_seq = [&](std::string seq, size_t seq_length) {
-            mseq = ""; mseq_vec.clear();
-            enc.for_each([&](auto x) { 
-                if(mseq_vec.empty() || !hp_compress || mseq_vec.back() != x) {
-                    mseq_vec.push_back(x); 
-                    mseq += sp.to_string(x);
-                }
-            }, seq.data(), seq_length);
-            return mseq;
-    };
-    return get_minimizer_seq(input_query, input_query.length());
+    digester.digest(input_query.data(), input_query.length(), mseq);
+    return mseq;
 }
 
 /*
@@ -480,31 +573,76 @@ void run_build_parse_cmd(SpumoniBuildOptions* build_opts, SpumoniHelperPrograms*
     OTHER_LOG(parse_log.data());
 }
 
-size_t run_build_ms_cmd(SpumoniBuildOptions* build_opts, SpumoniHelperPrograms* helper_bins) {
-    /* Runs the constructor for generating the final index for computing MS */
-    STATUS_LOG("build_ms", "building the index for computing MS");
+void print_index_benchmarks(const char* func, const std::vector<IndexBenchmark>& benchmarks) {
+    /* Prints the size and lookup times of each RLBWT and thresholds data-structure that was built */
+    FORCE_LOG(func, "index comparison (%d random lookups):", INDEX_BENCH_LOOKUPS);
+    FORCE_LOG(func, "    %-8s%-12s%-14s%-18s%-18s%-14s", "rlbwt", "thresholds", "index (MB)", "thresholds (MB)", 
+              "thr lookup (ns)", "LF step (ns)");
+    for (auto& bench: benchmarks) {
+        FORCE_LOG(func, "    %-8s%-12s%-14.2f%-18.2f%-18.1f%-14.1f", get_rlbwt_name(bench.bwt_type).data(), 
+                  get_thresholds_name(bench.thr_type).data(), bench.index_bytes/(1024.0 * 1024.0), 
+                  bench.thresholds_bytes/(1024.0 * 1024.0), bench.thr_lookup_ns, bench.lf_step_ns);
+    }
+}
+
+void print_sample_benchmarks(const char* func, const std::vector<IndexBenchmark>& benchmarks, size_t ssa_rate) {
+    /* Prints the size of the SA samples compared to keeping all of them, and the time to get one */
+    if (ssa_rate > 0) {FORCE_LOG(func, "SA samples are subsampled at rate %ld (at most %ld LF steps per lookup):", ssa_rate, ssa_rate);}
+    else {FORCE_LOG(func, "SA samples are all kept:");}
+    FORCE_LOG(func, "    %-8s%-12s%-16s%-16s%-18s", "rlbwt", "thresholds", "samples (MB)", "% of all", "sample lookup (ns)");
+    for (auto& bench: benchmarks) {
+        FORCE_LOG(func, "    %-8s%-12s%-16.2f%-16.1f%-18.1f", get_rlbwt_name(bench.bwt_type).data(), 
+                  get_thresholds_name(bench.thr_type).data(), bench.samples_bytes/(1024.0 * 1024.0),
+                  (bench.full_samples_bytes) ? (100.0 * bench.samples_bytes / bench.full_samples_bytes) : 100.0,
+                  bench.sample_lookup_ns);
+    }
+}
 
+size_t run_build_ms_cmd(SpumoniBuildOptions* build_opts, SpumoniHelperPrograms* helper_bins) {
+    /* Runs the constructor for generating the final index for computing MS, once per RLBWT and thresholds type */
     size_t length = 0, num_runs = 0;
-    auto start = std::chrono::system_clock::now();  
-    std::tie(length, num_runs) = build_spumoni_ms_main(build_opts->ref_file);
+    std::vector<IndexBenchmark> benchmarks;
+
+    for (auto bwt_type: build_opts->bwt_types) {
+        for (auto thr_type: build_opts->thr_types) {
+            STATUS_LOG("build_ms", "building the index for computing MS (%s rlbwt, %s thresholds)", 
+                       get_rlbwt_name(bwt_type).data(), get_thresholds_name(thr_type).data());
+
+            auto start = std::chrono::system_clock::now();  
+            benchmarks.emplace_back();
+            std::tie(length, num_runs) = build_spumoni_ms_main(build_opts->ref_file, bwt_type, thr_type, 
+                                                               build_opts->ssa_rate, benchmarks.back());
+            DONE_LOG((std::chrono::system_clock::now() - start));
+        }
+    }
     
     double average_run_size = (length + 0.0)/num_runs;
-    DONE_LOG((std::chrono::system_clock::now() - start));
     FORCE_LOG("build_ms", "bwt statistics: r = %ld, n = %ld, n/r = %.3f", num_runs, length, average_run_size);
+    print_index_benchmarks("build_ms", benchmarks);
+    print_sample_benchmarks("build_ms", benchmarks, build_opts->ssa_rate);
     return num_runs;
 }
 
 size_t run_build_pml_cmd(SpumoniBuildOptions* build_opts, SpumoniHelperPrograms* helper_bins) {
-    /* Runs the constructor for generating the final index for computing PML */
-    STATUS_LOG("build_pml", "building the index for computing PML");
-
+    /* Runs the constructor for generating the final index for computing PML, once per RLBWT and thresholds type */
     size_t length = 0, num_runs = 0;
-    auto start = std::chrono::system_clock::now();
-    std::tie(length, num_runs) = build_spumoni_main(build_opts->ref_file);
+    std::vector<IndexBenchmark> benchmarks;
+
+    for (auto bwt_type: build_opts->bwt_types) {
+        for (auto thr_type: build_opts->thr_types) {
+            STATUS_LOG("build_pml", "building the index for computing PML (%s rlbwt, %s thresholds)", 
+                       get_rlbwt_name(bwt_type).data(), get_thresholds_name(thr_type).data());
+
+            auto start = std::chrono::system_clock::now();
+            benchmarks.emplace_back();
+            std::tie(length, num_runs) = build_spumoni_main(build_opts->ref_file, bwt_type, thr_type, benchmarks.back());
+            DONE_LOG((std::chrono::system_clock::now() - start));
+        }
+    }
 
     double average_run_size = (length + 0.0)/num_runs;
-    DONE_LOG((std::chrono::system_clock::now() - start));
     FORCE_LOG("build_pml", "bwt statistics: r = %ld, n = %ld, n/r = %.3f", num_runs, length, average_run_size);
+    print_index_benchmarks("build_pml", benchmarks);
     return num_runs;
 }
 
@@ -630,14 +768,14 @@ int build_main(int argc, char** argv) {
             RefBuilder refbuild (build_opts.ref_file.data(), build_opts.input_list.data(), build_ref_file.data(), null_read_file.data(),
                                 build_opts.build_doc, build_opts.input_list.length(), build_opts.use_minimizers,
                                 build_opts.use_promotions, build_opts.use_dna_letters,
-                                build_opts.k, build_opts.w, build_opts.use_rev_comp);
+                                build_opts.k, build_opts.w, build_opts.use_rev_comp, build_opts.use_canonical);
             build_opts.ref_file = refbuild.get_ref_path();
             null_read_file = refbuild.get_null_readfile();
         } else if (!build_opts.is_general_text) { // FASTA reference
             null_read_file = RefBuilder::parse_null_reads(build_opts.ref_file.data(), null_read_file.data());
             build_opts.ref_file = RefBuilder::build_reference(build_opts.ref_file.data(), build_ref_file.data(), build_opts.use_promotions,
                                                                 build_opts.use_dna_letters, build_opts.k,
-                                                                build_opts.w, build_opts.use_rev_comp);
+                                                                build_opts.w, build_opts.use_rev_comp, build_opts.use_canonical);
         } else if (build_opts.is_general_text) { // General text reference
             null_read_file = RefBuilder::parse_null_reads_from_general_text(build_opts.ref_file.data(), null_read_file.data());
         }
@@ -660,14 +798,14 @@ int build_main(int argc, char** argv) {
         task_start = std::chrono::system_clock::now();
         EmpNullDatabase null_db(build_opts.ref_file.data(), null_read_file.data(), build_opts.use_minimizers, MS,
                                 build_opts.use_promotions, build_opts.use_dna_letters, build_opts.k, build_opts.w, 
-                                build_opts.is_general_text);
+                                build_opts.use_canonical, build_opts.is_general_text);
 
         // Find null distribution of KS-stats to find threshold
         if (!build_opts.is_general_text) {
             find_threshold_based_on_null_ms_distribution(build_opts.ref_file.data(), null_read_file.data(), 
                                                          build_opts.use_minimizers, build_opts.use_promotions, 
                                                          build_opts.use_dna_letters, build_opts.k, build_opts.w, 
-                                                         null_db, build_opts.bin_size);
+                                                         build_opts.use_canonical, null_db, build_opts.bin_size);
         } else {
             null_db.ks_stat_threshold = 0.10;
         }
@@ -689,14 +827,14 @@ int build_main(int argc, char** argv) {
         task_start = std::chrono::system_clock::now();
         EmpNullDatabase null_db(build_opts.ref_file.data(), null_read_file.data(), build_opts.use_minimizers, PML,
                                 build_opts.use_promotions, build_opts.use_dna_letters, build_opts.k, build_opts.w, 
-                                build_opts.is_general_text);
+                                build_opts.use_canonical, build_opts.is_general_text);
         
         // Find null distribution of KS-stats to find threshold
         if (!build_opts.is_general_text) {
             find_threshold_based_on_null_pml_distribution(build_opts.ref_file.data(), null_read_file.data(), 
                                                           build_opts.use_minimizers, build_opts.use_promotions, 
                                                           build_opts.use_dna_letters, build_opts.k, build_opts.w, 
-                                                          null_db, build_opts.bin_size);
+                                                          build_opts.use_canonical, null_db, build_opts.bin_size);
         } else {
             null_db.ks_stat_threshold = 0.10;
         }
@@ -709,16 +847,36 @@ int build_main(int argc, char** argv) {
         std::cout << std::endl;
     }
 
+    // Build the q-gram prefilter if asked for as well
+    if (build_opts.prefilter_fp > 0.0) {
+        build_prefilter(build_opts.ref_file, null_read_file, build_opts.use_promotions, build_opts.use_dna_letters,
+                        build_opts.k, build_opts.w, build_opts.use_canonical, build_opts.prefilter_fp);
+        std::cout << std::endl;
+    }
+
     // Build the document array if asked for as well
     if (build_opts.build_doc) {
         STATUS_LOG("build_main", "building the document array");
         task_start = std::chrono::system_clock::now();
         DocumentArray doc_arr(build_opts.ref_file, num_runs);
+        find_doc_starts(build_opts.ref_file, build_opts.pml_index, doc_arr); // so listing can stop at document boundaries
+
+        // only one form is kept, so a stale file from an earlier build is not loaded instead
+        size_t plain_bytes = doc_arr.size_in_bytes();
+        std::string doc_extension = (build_opts.rl_doc) ? ".rldoc" : ".doc";
+        std::filesystem::remove(build_opts.ref_file + ((build_opts.rl_doc) ? ".doc" : ".rldoc"));
+        if (build_opts.rl_doc) {doc_arr.run_length_encode();}
 
-        std::ofstream out_stream(build_opts.ref_file + ".doc");
+        std::ofstream out_stream(build_opts.ref_file + doc_extension);
         doc_arr.serialize(out_stream);
         out_stream.close();
         DONE_LOG((std::chrono::system_clock::now() - task_start));
+
+        if (build_opts.rl_doc) {
+            FORCE_LOG("build_main", "run-length encoded document array uses %.2f MB instead of %.2f MB (%.1fx smaller)",
+                      doc_arr.size_in_bytes()/(1024.0 * 1024.0), plain_bytes/(1024.0 * 1024.0), 
+                      plain_bytes/std::max(doc_arr.size_in_bytes() + 0.0, 1.0));
+        }
     }
 
     if (!build_opts.keep_files) {rm_temp_build_files(&build_opts, &helper_bins); std::cout << "\n";}
@@ -753,6 +911,9 @@ int run_main(int argc, char** argv) {
     else
         run_opts.ref_file += ".fa";
 
+    // Use the RLBWT and thresholds that were requested, otherwise detect them from the index files
+    find_index_type(run_opts.ref_file, run_opts.result_type, run_opts.bwt_type, run_opts.thr_type);
+
     switch (run_opts.result_type) {
         case MS: run_spumoni_ms_main(&run_opts); break;
         case PML: run_spumoni_main(&run_opts); break;